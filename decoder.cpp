@@ -0,0 +1,132 @@
+#include "decoder.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+// Diff formats for each indentation level, Diff keeps a pointer to its format
+static const char* indentFormats[] = {
+    "%s",
+    "  %s",
+    "    %s",
+    "      %s",
+    "        %s",
+    "          %s",
+    "            %s",
+    "              %s",
+    "                %s",
+    "                  %s",
+    "                    %s",
+    "                      %s",
+};
+
+#define MAX_INDENT_DEPTH ((int)(sizeof(indentFormats) / sizeof(indentFormats[0])) - 1)
+
+DecoderRegistry::~DecoderRegistry()
+{
+    for (void* library : libraries) {
+#ifdef _WIN32
+        FreeLibrary((HMODULE)library);
+#else
+        dlclose(library);
+#endif
+    }
+}
+
+bool DecoderRegistry::loadPlugin(const char* path)
+{
+#ifdef _WIN32
+    HMODULE library = LoadLibraryA(path);
+    if (!library) {
+        fprintf(stderr, "Could not load plugin %s (error %lu)\n", path, GetLastError());
+        return false;
+    }
+    HipDiffGetPluginFunc getPlugin = (HipDiffGetPluginFunc)GetProcAddress(library, HIPDIFF_PLUGIN_ENTRY);
+#else
+    void* library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        fprintf(stderr, "Could not load plugin %s (%s)\n", path, dlerror());
+        return false;
+    }
+    HipDiffGetPluginFunc getPlugin = (HipDiffGetPluginFunc)dlsym(library, HIPDIFF_PLUGIN_ENTRY);
+#endif
+    libraries.push_back((void*)library);
+
+    if (!getPlugin) {
+        fprintf(stderr, "Plugin %s does not export " HIPDIFF_PLUGIN_ENTRY "\n", path);
+        return false;
+    }
+
+    const HipDiffPlugin* plugin = getPlugin();
+    if (!plugin || plugin->version != HIPDIFF_PLUGIN_VERSION) {
+        fprintf(stderr, "Plugin %s was built for a different version of hipdiff\n", path);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < plugin->decoderCount; i++) {
+        registerDecoder(&plugin->decoders[i]);
+    }
+    return true;
+}
+
+void DecoderRegistry::registerDecoder(const HipDiffDecoder* decoder)
+{
+    decoders[decoder->assetType] = decoder;
+}
+
+const HipDiffDecoder* DecoderRegistry::find(uint32_t assetType) const
+{
+    auto it = decoders.find(assetType);
+    return (it != decoders.end()) ? it->second : nullptr;
+}
+
+static void emitDecodedDiff(void* context, int type, int depth, const char* left, const char* right)
+{
+    std::vector<DecodedDiff>& diffs = *(std::vector<DecodedDiff>*)context;
+
+    DecodedDiff diff;
+    switch (type) {
+    case HIPDIFF_FIELD_ADDITION: diff.type = Diff::Type::Addition; break;
+    case HIPDIFF_FIELD_DELETION: diff.type = Diff::Type::Deletion; break;
+    default: diff.type = Diff::Type::Modification; break;
+    }
+    diff.depth = (depth < 0) ? 0 : depth;
+    if (left && diff.type != Diff::Type::Addition) diff.left = left;
+    if (right && diff.type != Diff::Type::Deletion) diff.right = right;
+    diffs.push_back(diff);
+}
+
+bool decodeDiff(const HipDiffDecoder* decoder, const void* odata, uint32_t osize, const void* mdata, uint32_t msize,
+                std::vector<DecodedDiff>& diffs)
+{
+    return decoder->diff(odata, osize, mdata, msize, emitDecodedDiff, &diffs) != 0;
+}
+
+void appendDecodedDiffs(const std::vector<DecodedDiff>& decoded, int baseDepth, std::deque<std::string>& pool,
+                        std::vector<Diff>& diffs)
+{
+    for (const DecodedDiff& d : decoded) {
+        int depth = baseDepth + d.depth;
+        if (depth > MAX_INDENT_DEPTH) depth = MAX_INDENT_DEPTH;
+
+        Diff diff;
+        diff.type = d.type;
+        diff.fmt = indentFormats[depth];
+        diff.left = diffValue(nullptr);
+        diff.right = diffValue(nullptr);
+        diff.assetType = 0;
+        if (d.type != Diff::Type::Addition) {
+            pool.push_back(d.left);
+            diff.left = diffValue(pool.back().c_str());
+        }
+        if (d.type != Diff::Type::Deletion) {
+            pool.push_back(d.right);
+            diff.right = diffValue(pool.back().c_str());
+        }
+        diffs.push_back(diff);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "plugin.h"
+#include "output.h"
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Decoders keyed by asset type, from plugins loaded at startup
+class DecoderRegistry
+{
+public:
+    ~DecoderRegistry();
+
+    // Load a plugin and register its decoders, later plugins override earlier ones
+    bool loadPlugin(const char* path);
+    void registerDecoder(const HipDiffDecoder* decoder);
+
+    bool empty() const { return decoders.empty(); }
+    const HipDiffDecoder* find(uint32_t assetType) const;
+
+private:
+    std::unordered_map<uint32_t, const HipDiffDecoder*> decoders;
+    std::vector<void*> libraries;
+};
+
+// The field diffs a decoder produced for one asset
+struct DecodedDiff
+{
+    Diff::Type type;
+    int depth;
+    std::string left;
+    std::string right;
+};
+
+// Run a decoder on two payloads, returns false if it failed to decode them
+bool decodeDiff(const HipDiffDecoder* decoder, const void* odata, uint32_t osize, const void* mdata, uint32_t msize,
+                std::vector<DecodedDiff>& diffs);
+
+// Convert decoded diffs to Diffs indented below baseDepth. The strings are copied into
+// pool, which must outlive the Diffs
+void appendDecodedDiffs(const std::vector<DecodedDiff>& decoded, int baseDepth, std::deque<std::string>& pool,
+                        std::vector<Diff>& diffs);
@@ -0,0 +1,359 @@
+#include "export.h"
+
+#include "output.h"
+#include "platform.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#define EXPORT_STATUS_WIDTH 9 // "unchanged"
+
+ColumnTable::ColumnTable(const char* name, size_t rowCount) : tableName(name), rows(rowCount)
+{
+}
+
+void* ColumnTable::addColumn(const char* name, ColumnType type, uint32_t width)
+{
+    Column column;
+    column.name = name;
+    column.type = type;
+    column.width = width;
+    column.data.resize(rows * width);
+    cols.push_back(std::move(column));
+    return cols.back().data.data();
+}
+
+uint8_t* ColumnTable::addU8(const char* name)
+{
+    return (uint8_t*)addColumn(name, ColumnType::U8, sizeof(uint8_t));
+}
+
+uint32_t* ColumnTable::addU32(const char* name)
+{
+    return (uint32_t*)addColumn(name, ColumnType::U32, sizeof(uint32_t));
+}
+
+int32_t* ColumnTable::addI32(const char* name)
+{
+    return (int32_t*)addColumn(name, ColumnType::I32, sizeof(int32_t));
+}
+
+int64_t* ColumnTable::addI64(const char* name)
+{
+    return (int64_t*)addColumn(name, ColumnType::I64, sizeof(int64_t));
+}
+
+uint32_t* ColumnTable::addFourCC(const char* name)
+{
+    return (uint32_t*)addColumn(name, ColumnType::FourCC, sizeof(uint32_t));
+}
+
+char* ColumnTable::addString(const char* name, uint32_t width)
+{
+    return (char*)addColumn(name, ColumnType::String, width);
+}
+
+const char* ColumnTable::name() const
+{
+    return tableName.c_str();
+}
+
+size_t ColumnTable::rowCount() const
+{
+    return rows;
+}
+
+const std::deque<Column>& ColumnTable::columns() const
+{
+    return cols;
+}
+
+// Integers are formatted by hand, printf per field would dominate the export
+static char* formatUnsigned(char* end, uint64_t value)
+{
+    do {
+        *--end = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    return end;
+}
+
+static void writeInteger(OutputBuffer& out, int64_t value)
+{
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* start = formatUnsigned(end, value < 0 ? 0 - (uint64_t)value : (uint64_t)value);
+    if (value < 0) *--start = '-';
+    out.write(start, end - start);
+}
+
+static void writeCsvString(OutputBuffer& out, const char* str, size_t maxLength)
+{
+    size_t length = strnlen(str, maxLength);
+
+    bool quote = false;
+    for (size_t i = 0; i < length && !quote; i++) {
+        quote = (str[i] == ',' || str[i] == '"' || str[i] == '\r' || str[i] == '\n');
+    }
+    if (!quote) {
+        out.write(str, length);
+        return;
+    }
+
+    out.writeChar('"');
+    for (size_t i = 0; i < length; i++) {
+        if (str[i] == '"') out.writeChar('"');
+        out.writeChar(str[i]);
+    }
+    out.writeChar('"');
+}
+
+static void writeCsvValue(OutputBuffer& out, const Column& column, size_t row)
+{
+    const uint8_t* value = column.data.data() + row * column.width;
+    switch (column.type) {
+    case ColumnType::U8: writeInteger(out, *value); break;
+    case ColumnType::U32: writeInteger(out, *(const uint32_t*)value); break;
+    case ColumnType::I32: writeInteger(out, *(const int32_t*)value); break;
+    case ColumnType::I64: writeInteger(out, *(const int64_t*)value); break;
+    case ColumnType::FourCC: {
+        uint32_t type = *(const uint32_t*)value;
+        char chars[4];
+        for (int i = 0; i < 4; i++) {
+            char c = (char)(type >> (24 - i * 8));
+            chars[i] = isprint((unsigned char)c) ? c : '?';
+        }
+        writeCsvString(out, chars, 4);
+        break;
+    }
+    case ColumnType::String:
+        writeCsvString(out, (const char*)value, column.width);
+        break;
+    }
+}
+
+static bool writeCsv(const ColumnTable& table, FILE* file)
+{
+    OutputBuffer out(file);
+    const std::deque<Column>& columns = table.columns();
+
+    for (size_t c = 0; c < columns.size(); c++) {
+        if (c) out.writeChar(',');
+        out.writeString(columns[c].name.c_str());
+    }
+    out.writeChar('\n');
+
+    for (size_t row = 0; row < table.rowCount(); row++) {
+        for (size_t c = 0; c < columns.size(); c++) {
+            if (c) out.writeChar(',');
+            writeCsvValue(out, columns[c], row);
+        }
+        out.writeChar('\n');
+    }
+
+    out.flush();
+    return !ferror(file);
+}
+
+static void writePadding(FILE* file, size_t size)
+{
+    static const char zeros[8] = {};
+    if (size % 8) fwrite(zeros, 1, 8 - size % 8, file);
+}
+
+static bool writeColumnar(const ColumnTable& table, FILE* file)
+{
+    const std::deque<Column>& columns = table.columns();
+
+    uint32_t header[4] = { 0, EXPORT_COLUMNAR_VERSION, (uint32_t)columns.size(), 0 };
+    memcpy(header, EXPORT_COLUMNAR_MAGIC, 4);
+    uint64_t rowCount = table.rowCount();
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(&rowCount, sizeof(rowCount), 1, file);
+
+    size_t headerSize = sizeof(header) + sizeof(rowCount);
+    for (const Column& column : columns) {
+        uint8_t type = (uint8_t)column.type;
+        uint8_t reserved = 0;
+        uint16_t nameLength = (uint16_t)column.name.size();
+        fwrite(&type, 1, 1, file);
+        fwrite(&reserved, 1, 1, file);
+        fwrite(&nameLength, sizeof(nameLength), 1, file);
+        fwrite(&column.width, sizeof(column.width), 1, file);
+        fwrite(column.name.data(), 1, nameLength, file);
+        headerSize += 8 + nameLength;
+    }
+    writePadding(file, headerSize);
+
+    // Columns are already in their file layout
+    for (const Column& column : columns) {
+        fwrite(column.data.data(), 1, column.data.size(), file);
+        writePadding(file, column.data.size());
+    }
+
+    return !ferror(file);
+}
+
+static bool writeTable(const ColumnTable& table, const char* prefix, ExportFormat format)
+{
+    std::string path = prefix;
+    path += table.name();
+    path += (format == ExportFormat::Csv) ? ".csv" : ".hdc";
+
+    FILE* file = nullptr;
+    fopen_s(&file, path.c_str(), "wb");
+    if (!file) {
+        printf("Could not open file '%s'\n", path.c_str());
+        return false;
+    }
+
+    bool written = (format == ExportFormat::Csv) ? writeCsv(table, file) : writeColumnar(table, file);
+    if (fclose(file) != 0) written = false;
+
+    if (!written) printf("Could not write file '%s'\n", path.c_str());
+    return written;
+}
+
+static void fillAssetColumns(size_t first, uint8_t fileIndex, const Hip& hip,
+                             uint8_t* files, uint32_t* indices, uint32_t* ids, uint32_t* types, uint32_t* offsets,
+                             uint32_t* sizes, uint32_t* pluses, uint32_t* flags, uint32_t* aligns,
+                             char* names, char* filenames, uint32_t* checksums)
+{
+    for (uint32_t i = 0; i < hip.pcnt.assetCount; i++) {
+        size_t row = first + i;
+        const Hip::AHDR& ahdr = hip.ahdr[i];
+        const Hip::ADBG& adbg = hip.adbg[i];
+
+        files[row] = fileIndex;
+        indices[row] = i;
+        ids[row] = ahdr.id;
+        types[row] = ahdr.type;
+        offsets[row] = ahdr.offset;
+        sizes[row] = ahdr.size;
+        pluses[row] = ahdr.plus;
+        flags[row] = ahdr.flags;
+        aligns[row] = adbg.align;
+        checksums[row] = adbg.checksum;
+
+        // Pooled strings are already zero padded to the column width
+        memcpy(names + row * HIP_STRING_SIZE, adbg.name, HIP_STRING_SIZE);
+        memcpy(filenames + row * HIP_STRING_SIZE, adbg.filename, HIP_STRING_SIZE);
+    }
+}
+
+static void buildAssetTable(const Hip& ohip, const Hip& mhip, ColumnTable& table)
+{
+    uint8_t* files = table.addU8("file");
+    uint32_t* indices = table.addU32("index");
+    uint32_t* ids = table.addU32("id");
+    uint32_t* types = table.addFourCC("type");
+    uint32_t* offsets = table.addU32("offset");
+    uint32_t* sizes = table.addU32("size");
+    uint32_t* pluses = table.addU32("plus");
+    uint32_t* flags = table.addU32("flags");
+    uint32_t* aligns = table.addU32("align");
+    char* names = table.addString("name", HIP_STRING_SIZE);
+    char* filenames = table.addString("filename", HIP_STRING_SIZE);
+    uint32_t* checksums = table.addU32("checksum");
+
+    fillAssetColumns(0, 0, ohip, files, indices, ids, types, offsets, sizes, pluses, flags, aligns, names, filenames, checksums);
+    fillAssetColumns(ohip.pcnt.assetCount, 1, mhip, files, indices, ids, types, offsets, sizes, pluses, flags, aligns, names, filenames, checksums);
+}
+
+static void buildLayerTable(const Hip& ohip, const Hip& mhip, ColumnTable& table)
+{
+    uint8_t* files = table.addU8("file");
+    uint32_t* indices = table.addU32("index");
+    uint32_t* types = table.addU32("type");
+    uint32_t* assetCounts = table.addU32("assetCount");
+
+    size_t row = 0;
+    const Hip* hips[2] = { &ohip, &mhip };
+    for (uint8_t f = 0; f < 2; f++) {
+        for (uint32_t i = 0; i < hips[f]->pcnt.layerCount; i++, row++) {
+            files[row] = f;
+            indices[row] = i;
+            types[row] = hips[f]->lhdr[i].type;
+            assetCounts[row] = hips[f]->lhdr[i].assetCount;
+        }
+    }
+}
+
+static void buildLayerAssetTable(const Hip& ohip, const Hip& mhip, ColumnTable& table)
+{
+    uint8_t* files = table.addU8("file");
+    uint32_t* layers = table.addU32("layer");
+    uint32_t* positions = table.addU32("position");
+    uint32_t* ids = table.addU32("id");
+
+    size_t row = 0;
+    const Hip* hips[2] = { &ohip, &mhip };
+    for (uint8_t f = 0; f < 2; f++) {
+        for (uint32_t i = 0; i < hips[f]->pcnt.layerCount; i++) {
+            const Hip::LHDR& lhdr = hips[f]->lhdr[i];
+            for (uint32_t j = 0; j < lhdr.assetCount; j++, row++) {
+                files[row] = f;
+                layers[row] = i;
+                positions[row] = j;
+                ids[row] = lhdr.assetIDs[j];
+            }
+        }
+    }
+}
+
+static void buildDiffTable(const Hip& ohip, const Hip& mhip, const AssetClassification& classification, ColumnTable& table)
+{
+    static const char* statusNames[] = { "unchanged", "added", "deleted", "modified" };
+
+    uint32_t* ids = table.addU32("id");
+    uint32_t* types = table.addFourCC("type");
+    char* statuses = table.addString("status", EXPORT_STATUS_WIDTH);
+    int32_t* oindices = table.addI32("oindex");
+    int32_t* mindices = table.addI32("mindex");
+    int64_t* osizes = table.addI64("osize");
+    int64_t* msizes = table.addI64("msize");
+    int64_t* sizeDeltas = table.addI64("sizeDelta");
+
+    for (size_t row = 0; row < table.rowCount(); row++) {
+        int32_t oidx = classification.oindices[row];
+        int32_t midx = classification.mindices[row];
+        int64_t osize = (oidx != -1) ? ohip.ahdr[oidx].size : 0;
+        int64_t msize = (midx != -1) ? mhip.ahdr[midx].size : 0;
+
+        ids[row] = classification.ids[row];
+        types[row] = (midx != -1) ? mhip.ahdr[midx].type : ohip.ahdr[oidx].type;
+        const char* status = statusNames[(int)classification.statuses[row]];
+        memcpy(statuses + row * EXPORT_STATUS_WIDTH, status, strlen(status));
+        oindices[row] = oidx;
+        mindices[row] = midx;
+        osizes[row] = osize;
+        msizes[row] = msize;
+        sizeDeltas[row] = msize - osize;
+    }
+}
+
+bool exportHips(const Hip& ohip, const Hip& mhip, const AssetClassification& classification,
+                const char* prefix, ExportFormat format)
+{
+    ColumnTable assets("assets", (size_t)ohip.pcnt.assetCount + mhip.pcnt.assetCount);
+    buildAssetTable(ohip, mhip, assets);
+    if (!writeTable(assets, prefix, format)) return false;
+
+    ColumnTable layers("layers", (size_t)ohip.pcnt.layerCount + mhip.pcnt.layerCount);
+    buildLayerTable(ohip, mhip, layers);
+    if (!writeTable(layers, prefix, format)) return false;
+
+    size_t layerAssetCount = 0;
+    for (uint32_t i = 0; i < ohip.pcnt.layerCount; i++) layerAssetCount += ohip.lhdr[i].assetCount;
+    for (uint32_t i = 0; i < mhip.pcnt.layerCount; i++) layerAssetCount += mhip.lhdr[i].assetCount;
+    ColumnTable layerAssets("layer_assets", layerAssetCount);
+    buildLayerAssetTable(ohip, mhip, layerAssets);
+    if (!writeTable(layerAssets, prefix, format)) return false;
+
+    ColumnTable diff("diff", classification.ids.size());
+    buildDiffTable(ohip, mhip, classification, diff);
+    if (!writeTable(diff, prefix, format)) return false;
+
+    return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "hip.h"
+
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+enum class ExportFormat
+{
+    Csv,
+    Columnar
+};
+
+// Binary columnar file (.hdc), little endian:
+//     char     magic[4]     "HDCF"
+//     uint32_t version      1
+//     uint32_t columnCount
+//     uint32_t reserved
+//     uint64_t rowCount
+//     columnCount times:
+//         uint8_t  type     ColumnType
+//         uint8_t  reserved
+//         uint16_t nameLength
+//         uint32_t width    Bytes per value
+//         char     name[nameLength]
+//     Padding to a multiple of 8 bytes
+//     The values of each column back to back, each column padded to a multiple of 8 bytes
+#define EXPORT_COLUMNAR_MAGIC "HDCF"
+#define EXPORT_COLUMNAR_VERSION 1
+
+enum class ColumnType : uint8_t
+{
+    U8 = 1,
+    U32 = 2,
+    I32 = 3,
+    I64 = 4,
+    FourCC = 5, // uint32_t asset type, written as its four characters in CSV
+    String = 6  // Zero padded to width
+};
+
+struct Column
+{
+    std::string name;
+    ColumnType type;
+    uint32_t width;
+    std::vector<uint8_t> data;
+};
+
+// A table stored column by column. Columns are filled through the returned arrays and
+// written whole
+class ColumnTable
+{
+public:
+    ColumnTable(const char* name, size_t rowCount);
+
+    uint8_t* addU8(const char* name);
+    uint32_t* addU32(const char* name);
+    int32_t* addI32(const char* name);
+    int64_t* addI64(const char* name);
+    uint32_t* addFourCC(const char* name);
+    char* addString(const char* name, uint32_t width); // Value i starts at i * width
+
+    const char* name() const;
+    size_t rowCount() const;
+    const std::deque<Column>& columns() const;
+
+private:
+    std::string tableName;
+    size_t rows;
+    std::deque<Column> cols; // Adding a column doesn't move the others' arrays
+
+    void* addColumn(const char* name, ColumnType type, uint32_t width);
+};
+
+// Diff classification of every asset ID in either file, in ID order
+enum class AssetStatus : uint8_t
+{
+    Unchanged,
+    Added,
+    Deleted,
+    Modified
+};
+
+struct AssetClassification
+{
+    std::vector<uint32_t> ids;
+    std::vector<int32_t> oindices; // -1 if added
+    std::vector<int32_t> mindices; // -1 if deleted
+    std::vector<AssetStatus> statuses;
+};
+
+// Write the asset, layer, layer asset and diff tables of both files to <prefix>assets,
+// <prefix>layers, <prefix>layer_assets and <prefix>diff (.csv or .hdc)
+bool exportHips(const Hip& ohip, const Hip& mhip, const AssetClassification& classification,
+                const char* prefix, ExportFormat format);
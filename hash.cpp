@@ -0,0 +1,156 @@
+#include "hash.h"
+
+#include <string.h>
+
+// https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const uint8_t* p)
+{
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static inline uint32_t read32(const uint8_t* p)
+{
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    acc *= PRIME64_1;
+    return acc;
+}
+
+static inline uint64_t mergeRound64(uint64_t acc, uint64_t val)
+{
+    acc ^= round64(0, val);
+    acc = acc * PRIME64_1 + PRIME64_4;
+    return acc;
+}
+
+uint64_t hashData(const void* data, size_t size, uint64_t seed)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = mergeRound64(h, v1);
+        h = mergeRound64(h, v2);
+        h = mergeRound64(h, v3);
+        h = mergeRound64(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+
+    h += (uint64_t)size;
+
+    while (p + 8 <= end) {
+        h ^= round64(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    while (p < end) {
+        h ^= (*p) * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+#define CRC32_POLY 0x04C11DB7
+
+// Slicing-by-8 tables: crcTable[k][b] is the CRC of byte b followed by k zero bytes.
+// x86 SSE4.2 crc32 only implements the Castagnoli polynomial, so it can't be used here
+static uint32_t crcTable[8][256];
+
+static bool initCRCTable()
+{
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t c = b << 24;
+        for (int i = 0; i < 8; i++) {
+            c = (c & 0x80000000) ? ((c << 1) ^ CRC32_POLY) : (c << 1);
+        }
+        crcTable[0][b] = c;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (uint32_t b = 0; b < 256; b++) {
+            uint32_t c = crcTable[k-1][b];
+            crcTable[k][b] = (c << 8) ^ crcTable[0][c >> 24];
+        }
+    }
+    return true;
+}
+
+static bool crcTableInitialized = initCRCTable();
+
+uint32_t assetChecksum(const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (size >= 8) {
+        uint32_t hi = crc ^ (((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3]);
+        crc = crcTable[7][hi >> 24]
+            ^ crcTable[6][(hi >> 16) & 0xFF]
+            ^ crcTable[5][(hi >> 8) & 0xFF]
+            ^ crcTable[4][hi & 0xFF]
+            ^ crcTable[3][p[4]]
+            ^ crcTable[2][p[5]]
+            ^ crcTable[1][p[6]]
+            ^ crcTable[0][p[7]];
+        p += 8;
+        size -= 8;
+    }
+
+    while (size--) {
+        crc = (crc << 8) ^ crcTable[0][(crc >> 24) ^ *p++];
+    }
+
+    return crc;
+}
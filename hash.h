@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 64-bit content hash used to compare asset data (XXH64)
+uint64_t hashData(const void* data, size_t size, uint64_t seed = 0);
+
+// ADBG checksum, computed like the engine's xUtil_crc_update: CRC-32 with polynomial
+// 0x04C11DB7, MSB first, initial value 0xFFFFFFFF and no final XOR
+uint32_t assetChecksum(const void* data, size_t size);
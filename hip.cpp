@@ -1,13 +1,31 @@
 #include "hip.h"
 
+#include "hash.h"
+#include "inputfile.h"
+#include "largealloc.h"
+#include "platform.h"
+
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdarg.h>
+
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
 
 #define PRINT_BLOCKS 0
 
 #define BLKID(a,b,c,d) ((a<<24)|(b<<16)|(c<<8)|(d<<0))
 
+#define HIP_CACHE_MAGIC BLKID('H','I','P','C')
+#define HIP_CACHE_VERSION 1
+
 static char* blockIDString(uint32_t id) {
     static char buf[5] = {};
     buf[0] = (id & 0xFF000000) >> 24;
@@ -17,7 +35,7 @@ static char* blockIDString(uint32_t id) {
     return buf;
 }
 
-static bool readLong(FILE* file, uint32_t* x)
+static bool readLong(InputFile* file, uint32_t* x)
 {
     assert(x);
     assert(file);
@@ -26,7 +44,7 @@ static bool readLong(FILE* file, uint32_t* x)
 
     uint32_t val;
 
-    size_t bytesRead = fread_s((void*)&val, sizeof(uint32_t), 1, sizeof(uint32_t), file);
+    size_t bytesRead = file->read(&val, sizeof(uint32_t));
     if (bytesRead != sizeof(uint32_t)) {
         return false;
     }
@@ -41,7 +59,7 @@ static bool readLong(FILE* file, uint32_t* x)
     return true;
 }
 
-static bool readString(FILE* file, char* buf, size_t bufsize)
+static bool readString(InputFile* file, char* buf, size_t bufsize)
 {
     assert(buf);
     assert(file);
@@ -53,7 +71,7 @@ static bool readString(FILE* file, char* buf, size_t bufsize)
 
     // Read characters into buffer
     while (len < bufsize) {
-        size_t bytesRead = fread_s((void*)&c, sizeof(char), 1, sizeof(char), file);
+        size_t bytesRead = file->read(&c, sizeof(char));
         if (bytesRead != sizeof(char)) {
             return false;
         }
@@ -70,7 +88,7 @@ static bool readString(FILE* file, char* buf, size_t bufsize)
     // If max size reached and there are still more characters left, read them (and throw em away)
     if (bufsize == 0 || (len == bufsize && c != '\0')) {
         while (true) {
-            size_t bytesRead = fread_s((void*)&c, sizeof(char), sizeof(char), 1, file);
+            size_t bytesRead = file->read(&c, sizeof(char));
             if (bytesRead != sizeof(char)) {
                 return false;
             }
@@ -83,11 +101,9 @@ static bool readString(FILE* file, char* buf, size_t bufsize)
 
     // Skip padding byte
     if (len & 1) {
-        fseek(file, 1, SEEK_CUR);
+        file->seek(file->tell() + 1);
     }
 
-    long pos = ftell(file);
-
     return true;
 }
 
@@ -100,30 +116,67 @@ Hip::~Hip()
 {
     close();
 
-    if (ahdr) free(ahdr);
-    if (lhdr) free(lhdr);
-    if (layerAssetIDs) free(layerAssetIDs);
-    if (dpak.data) free(dpak.data);
+    largeFree(ahdr, (sizeof(AHDR) + sizeof(ADBG)) * allocAssetCount);
+    largeFree(lhdr, (sizeof(LHDR) + sizeof(LDBG)) * allocLayerCount);
+    largeFree(layerAssetIDs, sizeof(uint32_t) * allocAssetCount);
+    largeFree(strings, sizeof(HipString) * stringCapacity);
+    largeFree(stringTable, sizeof(uint32_t) * stringTableSize);
+    ioFreeRegion(&dpakRegion);
 }
 
 bool Hip::open(const char* path)
 {
-    fopen_s(&file, path, "rb");
-    return (file != nullptr);
+    close();
+
+    file = new InputFile();
+    if (!file->open(path, getIoReadAhead())) {
+        close();
+        return false;
+    }
+    return true;
 }
 
 void Hip::close()
 {
     if (file) {
-        fclose(file);
+        delete file;
         file = nullptr;
     }
 }
 
-bool Hip::read()
+const char* Hip::lastError() const
+{
+    return errorString;
+}
+
+void Hip::setQuiet(bool quiet)
+{
+    this->quiet = quiet;
+}
+
+// Keep the first (innermost) error, the ones after it are just the chunks it propagated through
+void Hip::error(const char* fmt, ...)
+{
+    char buf[HIP_ERROR_SIZE];
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    if (!errorString[0]) {
+        memcpy(errorString, buf, sizeof(errorString));
+    }
+
+    if (!quiet) {
+        fprintf(stderr, "HIP: %s\n", buf);
+    }
+}
+
+bool Hip::read(HipTablesCallback tablesRead, void* user)
 {
     if (!file) {
-        fprintf(stderr, "HIP: File not opened\n");
+        error("File not opened");
         return false;
     }
 
@@ -132,26 +185,30 @@ bool Hip::read()
         switch (cid) {
         case BLKID('H','I','P','A'):
             if (!readHIPA()) {
-                fprintf(stderr, "HIP: Failed to read HIPA chunk\n");
+                error("Failed to read HIPA chunk");
                 return false;
             }
             valid = true;
             break;
         case BLKID('P','A','C','K'):
             if (!readPACK()) {
-                fprintf(stderr, "HIP: Failed to read PACK chunk\n");
+                error("Failed to read PACK chunk");
                 return false;
             }
             break;
         case BLKID('D','I','C','T'):
             if (!readDICT()) {
-                fprintf(stderr, "HIP: Failed to read DICT chunk\n");
+                error("Failed to read DICT chunk");
                 return false;
             }
             break;
         case BLKID('S','T','R','M'):
+            if (tablesRead) {
+                tablesRead(*this, user);
+                tablesRead = nullptr;
+            }
             if (!readSTRM()) {
-                fprintf(stderr, "HIP: Failed to read STRM chunk\n");
+                error("Failed to read STRM chunk");
                 return false;
             }
             break;
@@ -160,11 +217,13 @@ bool Hip::read()
         exitBlock();
 
         if (!valid) {
-            fprintf(stderr, "HIP: Not a valid HIP file\n");
+            error("Not a valid HIP file");
             return false;
         }
     }
 
+    if (tablesRead) tablesRead(*this, user);
+
     return true;
 }
 
@@ -179,37 +238,37 @@ bool Hip::readPACK()
         switch (cid) {
         case BLKID('P','V','E','R'):
             if (!readPVER()) {
-                fprintf(stderr, "HIP: Failed to read PVER chunk\n");
+                error("Failed to read PVER chunk");
                 return false;
             }
             break;
         case BLKID('P','F','L','G'):
             if (!readPFLG()) {
-                fprintf(stderr, "HIP: Failed to read PFLG chunk\n");
+                error("Failed to read PFLG chunk");
                 return false;
             }
             break;
         case BLKID('P','C','N','T'):
             if (!readPCNT()) {
-                fprintf(stderr, "HIP: Failed to read PCNT chunk\n");
+                error("Failed to read PCNT chunk");
                 return false;
             }
             break;
         case BLKID('P','C','R','T'):
             if (!readPCRT()) {
-                fprintf(stderr, "HIP: Failed to read PCRT chunk\n");
+                error("Failed to read PCRT chunk");
                 return false;
             }
             break;
         case BLKID('P','M','O','D'):
             if (!readPMOD()) {
-                fprintf(stderr, "HIP: Failed to read PMOD chunk\n");
+                error("Failed to read PMOD chunk");
                 return false;
             }
             break;
         case BLKID('P','L','A','T'):
             if (!readPLAT()) {
-                fprintf(stderr, "HIP: Failed to read PLAT chunk\n");
+                error("Failed to read PLAT chunk");
                 return false;
             }
             break;
@@ -270,7 +329,7 @@ bool Hip::readPLAT()
     if (!readLong(file, &plat.id)) return false;
 
     Block& blk = stack[stackDepth-1];
-    while ((uint32_t)ftell(file) < blk.endpos) {
+    while (file->tell() < blk.endpos) {
         if (plat.stringCount >= HIP_MAX_PLATFORM_STRINGS) {
             printf("HIP: Warning: more strings than expected in PLAT chunk, skipping (max is %d)\n", HIP_MAX_PLATFORM_STRINGS);
             break;
@@ -282,14 +341,18 @@ bool Hip::readPLAT()
     return true;
 }
 
-bool Hip::readDICT()
+// Allocate the asset and layer tables for the PCNT counts
+void Hip::allocateTables()
 {
-    layerAssetIDs = (uint32_t*)malloc(sizeof(uint32_t) * pcnt.assetCount);
+    allocAssetCount = pcnt.assetCount;
+    allocLayerCount = pcnt.layerCount;
+
+    layerAssetIDs = (uint32_t*)largeAlloc(sizeof(uint32_t) * pcnt.assetCount);
 
     // Allocate assets
     {
         size_t size = (sizeof(AHDR) + sizeof(ADBG)) * pcnt.assetCount;
-        void* buf = malloc(size);
+        void* buf = largeAlloc(size);
         assert(buf);
         memset(buf, 0, size);
 
@@ -297,28 +360,53 @@ bool Hip::readDICT()
         adbg = (ADBG*)(ahdr + pcnt.assetCount);
     }
 
+    // Allocate string pool, at most a name and a filename per asset plus the empty string
+    {
+        stringCapacity = pcnt.assetCount * 2 + 1;
+        stringTableSize = 16;
+        while (stringTableSize < stringCapacity * 2) stringTableSize <<= 1;
+
+        strings = (HipString*)largeAlloc(sizeof(HipString) * stringCapacity);
+        stringTable = (uint32_t*)largeAlloc(sizeof(uint32_t) * stringTableSize);
+        assert(strings && stringTable);
+        memset(stringTable, 0, sizeof(uint32_t) * stringTableSize);
+
+        // Assets without an ADBG chunk get empty strings
+        HipString empty = {};
+        const char* emptyString = internString(empty);
+        for (uint32_t i = 0; i < pcnt.assetCount; i++) {
+            adbg[i].name = emptyString;
+            adbg[i].filename = emptyString;
+        }
+    }
+
     // Allocate layers
     {
         size_t size = (sizeof(LHDR) + sizeof(LDBG)) * pcnt.layerCount;
-        void* buf = malloc(size);
+        void* buf = largeAlloc(size);
         assert(buf);
         memset(buf, 0, size);
 
         lhdr = (LHDR*)buf;
         ldbg = (LDBG*)(lhdr + pcnt.layerCount);
     }
+}
+
+bool Hip::readDICT()
+{
+    allocateTables();
 
     while (uint32_t cid = enterBlock()) {
         switch (cid) {
         case BLKID('A','T','O','C'):
             if (!readATOC()) {
-                fprintf(stderr, "HIP: Failed to read ATOC chunk\n");
+                error("Failed to read ATOC chunk");
                 return false;
             }
             break;
         case BLKID('L','T','O','C'):
             if (!readLTOC()) {
-                fprintf(stderr, "HIP: Failed to read LTOC chunk\n");
+                error("Failed to read LTOC chunk");
                 return false;
             }
             break;
@@ -337,13 +425,17 @@ bool Hip::readATOC()
         switch (cid) {
         case BLKID('A','I','N','F'):
             if (!readAINF()) {
-                fprintf(stderr, "HIP: Failed to read AINF chunk\n");
+                error("Failed to read AINF chunk");
                 return false;
             }
             break;
         case BLKID('A','H','D','R'):
+            if ((uint32_t)i >= pcnt.assetCount) {
+                error("More AHDR chunks than PCNT assetCount (%d)", pcnt.assetCount);
+                return false;
+            }
             if (!readAHDR(i)) {
-                fprintf(stderr, "HIP: Failed to read AHDR chunk\n");
+                error("Failed to read AHDR chunk");
                 return false;
             }
             i++;
@@ -352,7 +444,7 @@ bool Hip::readATOC()
 
         exitBlock();
     }
-    assert(i == pcnt.assetCount);
+    atoc.ahdrCount = i;
 
     return true;
 }
@@ -373,11 +465,18 @@ bool Hip::readAHDR(int i)
     if (!readLong(file, &ahdr[i].plus)) return false;
     if (!readLong(file, &ahdr[i].flags)) return false;
 
+    // The string pool has room for one ADBG per asset
+    bool hasADBG = false;
     while (uint32_t cid = enterBlock()) {
         switch (cid) {
         case BLKID('A','D','B','G'):
+            if (hasADBG) {
+                error("Asset 0x%08X has more than one ADBG chunk", ahdr[i].id);
+                return false;
+            }
+            hasADBG = true;
             if (!readADBG(i)) {
-                fprintf(stderr, "HIP: Failed to read ADBG chunk\n");
+                error("Failed to read ADBG chunk");
                 return false;
             }
             break;
@@ -391,14 +490,39 @@ bool Hip::readAHDR(int i)
 
 bool Hip::readADBG(int i)
 {
+    HipString name = {};
+    HipString filename = {};
+
     if (!readLong(file, &adbg[i].align)) return false;
-    if (!readString(file, adbg[i].name, HIP_STRING_SIZE)) return false;
-    if (!readString(file, adbg[i].filename, HIP_STRING_SIZE)) return false;
+    if (!readString(file, name.chars, HIP_STRING_SIZE)) return false;
+    if (!readString(file, filename.chars, HIP_STRING_SIZE)) return false;
     if (!readLong(file, &adbg[i].checksum)) return false;
 
+    adbg[i].name = internString(name);
+    adbg[i].filename = internString(filename);
+    if (!adbg[i].name || !adbg[i].filename) return false;
+
     return true;
 }
 
+const char* Hip::internString(const HipString& str)
+{
+    uint32_t mask = stringTableSize - 1;
+    uint32_t slot = (uint32_t)hashData(str.chars, HIP_STRING_SIZE) & mask;
+
+    while (uint32_t index = stringTable[slot]) {
+        const char* pooled = strings[index - 1].chars;
+        if (hipStringEqual(pooled, str.chars)) return pooled;
+        slot = (slot + 1) & mask;
+    }
+
+    if (stringCount == stringCapacity) return nullptr;
+
+    strings[stringCount] = str;
+    stringTable[slot] = ++stringCount;
+    return strings[stringCount - 1].chars;
+}
+
 bool Hip::readLTOC()
 {
     int i = 0;
@@ -407,13 +531,17 @@ bool Hip::readLTOC()
         switch (cid) {
         case BLKID('L','I','N','F'):
             if (!readLINF()) {
-                fprintf(stderr, "HIP: Failed to read LINF chunk\n");
+                error("Failed to read LINF chunk");
                 return false;
             }
             break;
         case BLKID('L','H','D','R'):
-            if (!readLHDR(i, assetIDs)) {
-                fprintf(stderr, "HIP: Failed to read LHDR chunk\n");
+            if ((uint32_t)i >= pcnt.layerCount) {
+                error("More LHDR chunks than PCNT layerCount (%d)", pcnt.layerCount);
+                return false;
+            }
+            if (!readLHDR(i, assetIDs, pcnt.assetCount - (uint32_t)(assetIDs - layerAssetIDs))) {
+                error("Failed to read LHDR chunk");
                 return false;
             }
             assetIDs += lhdr[i].assetCount;
@@ -423,8 +551,8 @@ bool Hip::readLTOC()
 
         exitBlock();
     }
-    assert((assetIDs - layerAssetIDs) == pcnt.assetCount);
-    assert(i == pcnt.layerCount);
+    ltoc.lhdrCount = i;
+    ltoc.assetIDCount = (uint32_t)(assetIDs - layerAssetIDs);
 
     return true;
 }
@@ -436,11 +564,16 @@ bool Hip::readLINF()
     return true;
 }
 
-bool Hip::readLHDR(int i, uint32_t* assetIDs)
+bool Hip::readLHDR(int i, uint32_t* assetIDs, uint32_t maxAssetIDs)
 {
     if (!readLong(file, &lhdr[i].type)) return false;
     if (!readLong(file, &lhdr[i].assetCount)) return false;
 
+    if (lhdr[i].assetCount > maxAssetIDs) {
+        error("More layer asset IDs than PCNT assetCount (%d)", pcnt.assetCount);
+        return false;
+    }
+
     if (lhdr[i].assetCount) {
         lhdr[i].assetIDs = assetIDs;
         for (uint32_t j = 0; j < lhdr[i].assetCount; j++) {
@@ -452,7 +585,7 @@ bool Hip::readLHDR(int i, uint32_t* assetIDs)
         switch (cid) {
         case BLKID('L','D','B','G'):
             if (!readLDBG(i)) {
-                fprintf(stderr, "HIP: Failed to read LDBG chunk\n");
+                error("Failed to read LDBG chunk");
                 return false;
             }
             break;
@@ -477,13 +610,13 @@ bool Hip::readSTRM()
         switch (cid) {
         case BLKID('D','H','D','R'):
             if (!readDHDR()) {
-                fprintf(stderr, "HIP: Failed to read DHDR chunk\n");
+                error("Failed to read DHDR chunk");
                 return false;
             }
             break;
         case BLKID('D','P','A','K'):
             if (!readDPAK()) {
-                fprintf(stderr, "HIP: Failed to read DPAK chunk\n");
+                error("Failed to read DPAK chunk");
                 return false;
             }
             break;
@@ -507,20 +640,34 @@ bool Hip::readDPAK()
     if (pcnt.assetCount == 0) return true;
 
     if (!readLong(file, &dpak.padAmount)) return false;
-    fseek(file, dpak.padAmount, SEEK_CUR);
+    file->seek(file->tell() + dpak.padAmount);
 
-    uint32_t dataStart = ftell(file);
+    uint32_t dataStart = file->tell();
     uint32_t dataSize = stack[stackDepth-1].endpos - dataStart;
 
-    dpak.data = (char*)malloc(dataSize);
-    assert(dpak.data);
+    dpak.dataStart = dataStart;
+    dpak.dataSize = dataSize;
 
-    if (fread(dpak.data, 1, dataSize, file) != dataSize) {
-        fprintf(stderr, "HIP: Failed to read DPAK data\n");
+    bool loaded;
+    if (file->readsAhead()) {
+        // The I/O thread is already streaming the data (always for pipes), copy it out as it arrives
+        loaded = ioAllocRegion(dataSize, &dpakRegion) && file->read(dpakRegion.data, dataSize) == dataSize;
+    } else {
+        loaded = ioReadRegion(file->handle(), dataStart, dataSize, &dpakRegion);
+    }
+    if (!loaded) {
+        error("Failed to read DPAK data");
         return false;
     }
-
-    for (uint32_t i = 0; i < pcnt.assetCount; i++) {
+    dpak.data = dpakRegion.data;
+
+    for (uint32_t i = 0; i < atoc.ahdrCount; i++) {
+        // Don't hand out pointers outside of the buffer, the asset data would be garbage anyway.
+        // The asset is left without data, validation reports it
+        if (ahdr[i].offset < dataStart || ahdr[i].size > dataSize || ahdr[i].offset - dataStart > dataSize - ahdr[i].size) {
+            ahdr[i].data = nullptr;
+            continue;
+        }
         ahdr[i].data = dpak.data + ahdr[i].offset - dataStart;
     }
 
@@ -531,11 +678,11 @@ uint32_t Hip::enterBlock()
 {
     assert(stackDepth < HIP_MAX_STACK_DEPTH);
     if (stackDepth >= HIP_MAX_STACK_DEPTH) {
-        fprintf(stderr, "HIP: Max block stack depth reached (%d)\n", HIP_MAX_STACK_DEPTH);
+        error("Max block stack depth reached (%d)", HIP_MAX_STACK_DEPTH);
         return 0;
     }
 
-    if (stackDepth > 0 && (uint32_t)ftell(file) >= stack[stackDepth-1].endpos) {
+    if (stackDepth > 0 && file->tell() >= stack[stackDepth-1].endpos) {
         // End of current block reached (not an error)
         return 0;
     }
@@ -546,7 +693,7 @@ uint32_t Hip::enterBlock()
 
     Block& blk = stack[stackDepth++];
     blk.id = id;
-    blk.endpos = ftell(file) + len;
+    blk.endpos = file->tell() + len;
 
 #if PRINT_BLOCKS
     for (int i = 0; i < stackDepth-1; i++) printf("  ");
@@ -560,10 +707,337 @@ void Hip::exitBlock()
 {
     assert(stackDepth > 0);
     if (stackDepth <= 0) {
-        fprintf(stderr, "HIP: Stack depth underflow\n");
+        error("Stack depth underflow");
         return;
     }
 
     Block& blk = stack[--stackDepth];
-    fseek(file, blk.endpos, SEEK_SET);
-}
\ No newline at end of file
+    file->seek(blk.endpos);
+}
+
+void Hip::overlay(const Hip* const* hips, uint32_t count, std::vector<uint32_t>& assetSources, std::vector<uint32_t>& layerSources)
+{
+    assert(!ahdr && !lhdr);
+    assert(count > 0);
+
+    const Hip& first = *hips[0];
+    pver = first.pver;
+    pflg = first.pflg;
+    pcnt = first.pcnt;
+    pcrt = first.pcrt;
+    pmod = first.pmod;
+    plat = first.plat;
+    ainf = first.ainf;
+    linf = first.linf;
+    dhdr = first.dhdr;
+
+    pcnt.assetCount = 0;
+    pcnt.layerCount = 0;
+    ltoc.lhdrCount = 0;
+    ltoc.assetIDCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const Hip& hip = *hips[i];
+        pcnt.assetCount += hip.pcnt.assetCount;
+        pcnt.layerCount += hip.pcnt.layerCount;
+        if (pcnt.maxAssetSize < hip.pcnt.maxAssetSize) pcnt.maxAssetSize = hip.pcnt.maxAssetSize;
+        if (pcnt.maxLayerSize < hip.pcnt.maxLayerSize) pcnt.maxLayerSize = hip.pcnt.maxLayerSize;
+        if (pcnt.maxXformAssetSize < hip.pcnt.maxXformAssetSize) pcnt.maxXformAssetSize = hip.pcnt.maxXformAssetSize;
+        ltoc.lhdrCount += hip.ltoc.lhdrCount;
+        ltoc.assetIDCount += hip.ltoc.assetIDCount;
+    }
+
+    // Sized for every asset of every archive, overridden ones just leave the end unused
+    allocateTables();
+
+    // Slot of each ID in the tables, so each asset is placed or overridden in one lookup
+    std::unordered_map<uint32_t, uint32_t> slots;
+    slots.reserve(pcnt.assetCount);
+
+    assetSources.clear();
+    assetSources.reserve(pcnt.assetCount);
+    layerSources.clear();
+    layerSources.reserve(pcnt.layerCount);
+
+    uint32_t assetIndex = 0;
+    uint32_t layerIndex = 0;
+    uint32_t* ids = layerAssetIDs;
+    for (uint32_t source = 0; source < count; source++) {
+        const Hip& hip = *hips[source];
+
+        for (uint32_t i = 0; i < hip.pcnt.assetCount; i++) {
+            auto slot = slots.emplace(hip.ahdr[i].id, assetIndex);
+            uint32_t index = slot.first->second;
+            if (slot.second) {
+                assetSources.push_back(source);
+                assetIndex++;
+            } else {
+                assetSources[index] = source;
+            }
+
+            HipString name;
+            HipString filename;
+            memcpy(name.chars, hip.adbg[i].name, HIP_STRING_SIZE);
+            memcpy(filename.chars, hip.adbg[i].filename, HIP_STRING_SIZE);
+
+            ahdr[index] = hip.ahdr[i];
+            adbg[index].align = hip.adbg[i].align;
+            adbg[index].checksum = hip.adbg[i].checksum;
+            adbg[index].name = internString(name);
+            adbg[index].filename = internString(filename);
+        }
+
+        for (uint32_t i = 0; i < hip.pcnt.layerCount; i++, layerIndex++) {
+            const LHDR& layer = hip.lhdr[i];
+            lhdr[layerIndex].type = layer.type;
+            lhdr[layerIndex].assetCount = layer.assetCount;
+            lhdr[layerIndex].assetIDs = layer.assetCount ? ids : nullptr;
+            ldbg[layerIndex] = hip.ldbg[i];
+            if (layer.assetCount) memcpy(ids, layer.assetIDs, sizeof(uint32_t) * layer.assetCount);
+            ids += layer.assetCount;
+            layerSources.push_back(source);
+        }
+    }
+
+    pcnt.assetCount = assetIndex;
+    atoc.ahdrCount = assetIndex;
+}
+
+// Table layout of parse caches and store manifests, native endian and padding. Bump
+// HIP_CACHE_VERSION whenever it or one of the chunk structs changes:
+//     uint32_t magic, version
+//     PVER, PFLG, PCNT, PCRT, PMOD, PLAT, ATOC, AINF, LTOC, LINF, DHDR
+//     uint32_t padAmount, dataStart, dataSize
+//     CacheAsset[pcnt.assetCount]
+//     CacheLayer[pcnt.layerCount]
+//     uint32_t assetIDs[ltoc.assetIDCount]
+//     uint32_t magic
+struct CacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    Hip::PVER pver;
+    Hip::PFLG pflg;
+    Hip::PCNT pcnt;
+    Hip::PCRT pcrt;
+    Hip::PMOD pmod;
+    Hip::PLAT plat;
+    Hip::ATOC atoc;
+    Hip::AINF ainf;
+    Hip::LTOC ltoc;
+    Hip::LINF linf;
+    Hip::DHDR dhdr;
+    uint32_t padAmount;
+    uint32_t dataStart;
+    uint32_t dataSize;
+};
+
+struct CacheAsset
+{
+    uint32_t id;
+    uint32_t type;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t plus;
+    uint32_t flags;
+    uint32_t align;
+    uint32_t checksum;
+    HipString name;
+    HipString filename;
+    uint64_t dataHash;
+};
+
+struct CacheLayer
+{
+    uint32_t type;
+    uint32_t assetCount;
+    uint32_t ldbg;
+};
+
+bool Hip::writeTables(FILE* out, const std::vector<uint64_t>& dataHashes) const
+{
+    assert(dataHashes.size() == pcnt.assetCount);
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = HIP_CACHE_MAGIC;
+    header.version = HIP_CACHE_VERSION;
+    header.pver = pver;
+    header.pflg = pflg;
+    header.pcnt = pcnt;
+    header.pcrt = pcrt;
+    header.pmod = pmod;
+    header.plat = plat;
+    header.atoc = atoc;
+    header.ainf = ainf;
+    header.ltoc = ltoc;
+    header.linf = linf;
+    header.dhdr = dhdr;
+    header.padAmount = dpak.padAmount;
+    header.dataStart = dpak.dataStart;
+    header.dataSize = dpak.dataSize;
+
+    std::vector<CacheAsset> assets(pcnt.assetCount);
+    for (uint32_t i = 0; i < pcnt.assetCount; i++) {
+        CacheAsset& asset = assets[i];
+        memset(&asset, 0, sizeof(asset));
+        asset.id = ahdr[i].id;
+        asset.type = ahdr[i].type;
+        asset.offset = ahdr[i].offset;
+        asset.size = ahdr[i].size;
+        asset.plus = ahdr[i].plus;
+        asset.flags = ahdr[i].flags;
+        asset.align = adbg[i].align;
+        asset.checksum = adbg[i].checksum;
+        memcpy(asset.name.chars, adbg[i].name, HIP_STRING_SIZE);
+        memcpy(asset.filename.chars, adbg[i].filename, HIP_STRING_SIZE);
+        asset.dataHash = dataHashes[i];
+    }
+
+    std::vector<CacheLayer> layers(pcnt.layerCount);
+    for (uint32_t i = 0; i < pcnt.layerCount; i++) {
+        layers[i].type = lhdr[i].type;
+        layers[i].assetCount = lhdr[i].assetCount;
+        layers[i].ldbg = ldbg[i].ldbg;
+    }
+
+    uint32_t magic = HIP_CACHE_MAGIC;
+
+    return fwrite(&header, sizeof(header), 1, out) == 1
+        && fwrite(assets.data(), sizeof(CacheAsset), assets.size(), out) == assets.size()
+        && fwrite(layers.data(), sizeof(CacheLayer), layers.size(), out) == layers.size()
+        && fwrite(layerAssetIDs, sizeof(uint32_t), ltoc.assetIDCount, out) == ltoc.assetIDCount
+        && fwrite(&magic, sizeof(magic), 1, out) == 1;
+}
+
+bool Hip::writeCache(const char* path, const std::vector<uint64_t>& dataHashes) const
+{
+    // Written next to the cache file and renamed, so concurrent readers never see half of it
+    char tmpPath[1024];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", path, (int)getpid());
+
+    FILE* out = nullptr;
+    fopen_s(&out, tmpPath, "wb");
+    if (!out) return false;
+
+    bool written = writeTables(out, dataHashes);
+    if (fclose(out) != 0) written = false;
+
+    // Another process may have cached the same file first, which is just as good
+    if (!written || rename(tmpPath, path) != 0) {
+        remove(tmpPath);
+        return false;
+    }
+
+    return true;
+}
+
+bool Hip::readCache(const char* path, std::vector<uint64_t>& dataHashes)
+{
+    assert(!ahdr && !lhdr);
+
+    FILE* in = nullptr;
+    fopen_s(&in, path, "rb");
+    if (!in) return false;
+
+    std::vector<char> buf;
+    char chunk[65536];
+    while (size_t count = fread(chunk, 1, sizeof(chunk), in)) {
+        buf.insert(buf.end(), chunk, chunk + count);
+    }
+    fclose(in);
+
+    return readTables(buf.data(), buf.size(), dataHashes) != 0;
+}
+
+size_t Hip::readTables(const char* data, size_t size, std::vector<uint64_t>& dataHashes)
+{
+    assert(!ahdr && !lhdr);
+
+    // Check everything before touching the tables, so bad data leaves this Hip untouched
+    // for parsing the real file instead
+    CacheHeader header;
+    if (size < sizeof(header)) return 0;
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != HIP_CACHE_MAGIC || header.version != HIP_CACHE_VERSION) return 0;
+    if (header.ltoc.assetIDCount > header.pcnt.assetCount) return 0;
+
+    uint64_t tablesSize = sizeof(header)
+        + (uint64_t)sizeof(CacheAsset) * header.pcnt.assetCount
+        + (uint64_t)sizeof(CacheLayer) * header.pcnt.layerCount
+        + (uint64_t)sizeof(uint32_t) * header.ltoc.assetIDCount
+        + sizeof(uint32_t);
+    if (size < tablesSize) return 0;
+
+    const char* pos = data + sizeof(header);
+    const char* assets = pos; // Not necessarily 8 byte aligned, copied out one by one
+    pos += sizeof(CacheAsset) * header.pcnt.assetCount;
+    const CacheLayer* layers = (const CacheLayer*)pos;
+    pos += sizeof(CacheLayer) * header.pcnt.layerCount;
+    const char* assetIDs = pos;
+    pos += sizeof(uint32_t) * header.ltoc.assetIDCount;
+
+    uint32_t magic;
+    memcpy(&magic, pos, sizeof(magic));
+    if (magic != HIP_CACHE_MAGIC) return 0;
+
+    uint64_t layerAssetCount = 0;
+    for (uint32_t i = 0; i < header.pcnt.layerCount; i++) layerAssetCount += layers[i].assetCount;
+    if (layerAssetCount != header.ltoc.assetIDCount) return 0;
+
+    pver = header.pver;
+    pflg = header.pflg;
+    pcnt = header.pcnt;
+    pcrt = header.pcrt;
+    pmod = header.pmod;
+    plat = header.plat;
+    atoc = header.atoc;
+    ainf = header.ainf;
+    ltoc = header.ltoc;
+    linf = header.linf;
+    dhdr = header.dhdr;
+    dpak.padAmount = header.padAmount;
+    dpak.dataStart = header.dataStart;
+    dpak.dataSize = header.dataSize;
+
+    pcrt.string[HIP_STRING_SIZE - 1] = '\0';
+    if (plat.stringCount < 0 || plat.stringCount > HIP_MAX_PLATFORM_STRINGS) plat.stringCount = 0;
+    for (int i = 0; i < HIP_MAX_PLATFORM_STRINGS; i++) plat.strings[i][HIP_STRING_SIZE - 1] = '\0';
+
+    allocateTables();
+
+    // Asset data isn't cached, compare the hashes instead
+    dataHashes.resize(pcnt.assetCount);
+    for (uint32_t i = 0; i < pcnt.assetCount; i++) {
+        CacheAsset asset;
+        memcpy(&asset, assets + sizeof(CacheAsset) * i, sizeof(asset));
+        asset.name.chars[HIP_STRING_SIZE - 1] = '\0';
+        asset.filename.chars[HIP_STRING_SIZE - 1] = '\0';
+
+        ahdr[i].id = asset.id;
+        ahdr[i].type = asset.type;
+        ahdr[i].offset = asset.offset;
+        ahdr[i].size = asset.size;
+        ahdr[i].plus = asset.plus;
+        ahdr[i].flags = asset.flags;
+        ahdr[i].data = nullptr;
+        adbg[i].align = asset.align;
+        adbg[i].checksum = asset.checksum;
+        adbg[i].name = internString(asset.name);
+        adbg[i].filename = internString(asset.filename);
+        dataHashes[i] = asset.dataHash;
+    }
+
+    memcpy(layerAssetIDs, assetIDs, sizeof(uint32_t) * ltoc.assetIDCount);
+
+    uint32_t* ids = layerAssetIDs;
+    for (uint32_t i = 0; i < pcnt.layerCount; i++) {
+        lhdr[i].type = layers[i].type;
+        lhdr[i].assetCount = layers[i].assetCount;
+        lhdr[i].assetIDs = layers[i].assetCount ? ids : nullptr;
+        ldbg[i].ldbg = layers[i].ldbg;
+        ids += layers[i].assetCount;
+    }
+
+    return (size_t)tablesSize;
+}
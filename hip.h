@@ -2,12 +2,50 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "iobackend.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define HIP_STRING_SSE2 1
+#endif
 
 // https://heavyironmodding.org/wiki/EvilEngine/HIP_(File_Format)
 
 #define HIP_MAX_STACK_DEPTH 8
 #define HIP_MAX_PLATFORM_STRINGS 4
 #define HIP_STRING_SIZE 32
+#define HIP_ERROR_SIZE 256
+
+class InputFile;
+class Hip;
+
+// Called by Hip::read once the tables are read and before the asset data is, so they can be
+// used while the rest of the file is still arriving
+typedef void (*HipTablesCallback)(Hip& hip, void* user);
+
+// A zero padded ADBG string, interned in the pool of the file it came from
+struct HipString
+{
+    char chars[HIP_STRING_SIZE];
+};
+
+// Compare two pooled ADBG strings. Both are zero padded to HIP_STRING_SIZE, so this is
+// a fixed-width compare of the whole block
+inline bool hipStringEqual(const char* a, const char* b)
+{
+    if (a == b) return true;
+#ifdef HIP_STRING_SSE2
+    __m128i lo = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b));
+    __m128i hi = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + 16)), _mm_loadu_si128((const __m128i*)(b + 16)));
+    return _mm_movemask_epi8(_mm_and_si128(lo, hi)) == 0xFFFF;
+#else
+    return memcmp(a, b, HIP_STRING_SIZE) == 0;
+#endif
+}
 
 class Hip
 {
@@ -18,7 +56,28 @@ public:
     bool open(const char* path);
     void close();
 
-    bool read();
+    // tablesRead is called when the stream (STRM) starts, or at the end of a file without one
+    bool read(HipTablesCallback tablesRead = nullptr, void* user = nullptr);
+
+    const char* lastError() const;
+    void setQuiet(bool quiet);
+
+    // Save or restore everything but the asset data, with a hash of each asset's data in
+    // its place. Restoring leaves AHDR data null and must be done on a fresh Hip
+    bool writeCache(const char* path, const std::vector<uint64_t>& dataHashes) const;
+    bool readCache(const char* path, std::vector<uint64_t>& dataHashes);
+
+    // The same for embedding in other files. readTables returns the number of bytes used,
+    // 0 if the data isn't valid
+    bool writeTables(FILE* out, const std::vector<uint64_t>& dataHashes) const;
+    size_t readTables(const char* data, size_t size, std::vector<uint64_t>& dataHashes);
+
+    // Combine a stack of archives into one set of tables. An asset ID in several archives
+    // resolves to the last one, at the position it first appeared. Layers are appended in
+    // stack order and header chunks are the first archive's, with PCNT counts summed.
+    // Asset data still points into the archives, so they must outlive this Hip. Fills the
+    // stack index each asset and layer came from. Must be done on a fresh Hip
+    void overlay(const Hip* const* hips, uint32_t count, std::vector<uint32_t>& assetSources, std::vector<uint32_t>& layerSources);
 
     struct HIPA {} hipa;
     struct PACK {} pack;
@@ -51,7 +110,9 @@ public:
         char strings[HIP_MAX_PLATFORM_STRINGS][HIP_STRING_SIZE];
     } plat;
     struct DICT {} dict;
-    struct ATOC {} atoc;
+    struct ATOC {
+        uint32_t ahdrCount; // Number of AHDR chunks actually read
+    } atoc;
     struct AINF {
         uint32_t ainf;
     } ainf;
@@ -62,15 +123,18 @@ public:
         uint32_t size;
         uint32_t plus;
         uint32_t flags;
-        char* data;
+        char* data; // Null if it points outside of DPAK or only the tables were loaded
     } *ahdr;
     struct ADBG {
         uint32_t align;
-        char name[HIP_STRING_SIZE];
-        char filename[HIP_STRING_SIZE];
+        const char* name;     // Points into the string pool, use hipStringEqual to compare
+        const char* filename; // Points into the string pool, use hipStringEqual to compare
         uint32_t checksum;
     } *adbg;
-    struct LTOC {} ltoc;
+    struct LTOC {
+        uint32_t lhdrCount;    // Number of LHDR chunks actually read
+        uint32_t assetIDCount; // Total asset IDs in all LHDR chunks
+    } ltoc;
     struct LINF {
         uint32_t linf;
     } linf;
@@ -88,7 +152,9 @@ public:
     } dhdr;
     struct DPAK {
         uint32_t padAmount;
-        char* data;
+        uint32_t dataStart; // File offset of data
+        uint32_t dataSize;
+        char* data; // Loaded by the selected I/O backend
     } dpak;
 
 private:
@@ -98,10 +164,22 @@ private:
         uint32_t endpos;
     };
 
-    FILE* file;
+    InputFile* file;
     Block stack[HIP_MAX_STACK_DEPTH];
     int stackDepth;
     uint32_t* layerAssetIDs;
+    uint32_t allocAssetCount; // pcnt counts the asset and layer tables were allocated for
+    uint32_t allocLayerCount;
+    IoRegion dpakRegion;
+
+    // ADBG string pool. Equal strings share a slot, the table holds slot index + 1
+    HipString* strings;
+    uint32_t stringCount;
+    uint32_t stringCapacity;
+    uint32_t* stringTable;
+    uint32_t stringTableSize; // Power of 2
+    char errorString[HIP_ERROR_SIZE];
+    bool quiet;
 
     bool readHIPA();
     bool readPACK();
@@ -118,12 +196,17 @@ private:
     bool readADBG(int i);
     bool readLTOC();
     bool readLINF();
-    bool readLHDR(int i, uint32_t* assetIDs);
+    bool readLHDR(int i, uint32_t* assetIDs, uint32_t maxAssetIDs);
     bool readLDBG(int i);
     bool readSTRM();
     bool readDHDR();
     bool readDPAK();
 
+    void allocateTables();
+    const char* internString(const HipString& str);
+
     uint32_t enterBlock();
     void exitBlock();
+
+    void error(const char* fmt, ...);
 };
\ No newline at end of file
@@ -0,0 +1,258 @@
+#include "html.h"
+
+#include <string.h>
+
+// Max length of a single formatted diff side
+#define DIFF_TEXT_SIZE 256
+
+static const char* htmlHead =
+    "<!DOCTYPE html>\n"
+    "<html>\n"
+    "<head>\n"
+    "<meta charset=\"utf-8\">\n"
+    "<title>HIPDiff</title>\n"
+    "<style>\n"
+    "body{margin:0;font:13px monospace;background:#1e1e1e;color:#ddd;display:flex;flex-direction:column;height:100vh}\n"
+    "#bar{padding:6px 8px;background:#2d2d2d;display:flex;gap:12px;align-items:center;flex-wrap:wrap}\n"
+    "#bar input[type=text]{width:240px;background:#1e1e1e;color:#ddd;border:1px solid #555;padding:2px 4px}\n"
+    "#bar button,#bar select{background:#3a3a3a;color:#ddd;border:1px solid #555}\n"
+    "#names{display:flex;padding:4px 0;border-bottom:1px solid #555;font-weight:bold}\n"
+    "#names div,.row div{flex:1;overflow:hidden;white-space:pre;text-overflow:ellipsis;padding-right:8px}\n"
+    "#view{flex:1;overflow-y:auto;position:relative}\n"
+    "#rows{position:absolute;left:0;right:0;top:0}\n"
+    ".row{position:absolute;left:0;right:0;height:18px;line-height:18px;display:flex}\n"
+    ".row.kid{cursor:pointer}\n"
+    ".row.kid:hover{background:#2a2a2a}\n"
+    ".sec{color:#fff;font-weight:bold;background:#252525}\n"
+    ".add{color:#6c6}.del{color:#e66}.mod{color:#dc6}\n"
+    "</style>\n"
+    "</head>\n"
+    "<body>\n"
+    "<div id=\"bar\">\n"
+    "<input type=\"text\" id=\"filter\" placeholder=\"Filter by name\">\n"
+    "<select id=\"type\"><option value=\"-1\">All types</option></select>\n"
+    "<label><input type=\"checkbox\" id=\"showAdd\" checked> Additions</label>\n"
+    "<label><input type=\"checkbox\" id=\"showDel\" checked> Deletions</label>\n"
+    "<label><input type=\"checkbox\" id=\"showMod\" checked> Modifications</label>\n"
+    "<button id=\"expand\">Expand all</button>\n"
+    "<button id=\"collapse\">Collapse all</button>\n"
+    "<span id=\"totals\"></span>\n"
+    "</div>\n"
+    "<div id=\"names\"><div id=\"oname\"></div><div id=\"mname\"></div></div>\n"
+    "<div id=\"view\"><div id=\"spacer\"></div><div id=\"rows\"></div></div>\n";
+
+// Row types and depths are written as strings of digits and row sections as the first
+// row of each section, the full columns are rebuilt on load.
+// Rows are only created for the visible part of the list, a diff of any size renders
+// as fast as a small one. Rows nested deeper than the one before are its details and
+// start collapsed. Filters apply to top level rows, their details follow them. Picking an
+// asset type leaves only the rows about assets of that type
+static const char* htmlScript =
+    "<script>\n"
+    "(function(){\n"
+    "var D=JSON.parse(document.getElementById('data').textContent);\n"
+    "var H=18,N=D.rt.length,st=D.st,i,j;\n"
+    "var rs=new Int32Array(N),rt=new Uint8Array(N),rd=new Uint8Array(N);\n"
+    "for(i=0;i<N;i++){rt[i]=D.rt.charCodeAt(i)-48;rd[i]=D.rd.charCodeAt(i)-48;}\n"
+    "for(j=0;j<D.ss.length;j++)for(i=D.ss[j];i<(j+1<D.ss.length?D.ss[j+1]:N);i++)rs[i]=j;\n"
+    "D.rs=rs;D.rt=rt;D.rd=rd;\n"
+    "var kids=new Uint8Array(N),open=new Uint8Array(N),top=new Int32Array(N);\n"
+    "var minDepth=new Uint8Array(D.ss.length).fill(255),cur=-1;\n"
+    "for(i=0;i<N;i++)if(D.rd[i]<minDepth[D.rs[i]])minDepth[D.rs[i]]=D.rd[i];\n"
+    "for(i=0;i<N;i++){\n"
+    "if(i+1<N&&D.rs[i+1]==D.rs[i]&&D.rd[i+1]>D.rd[i])kids[i]=1;\n"
+    "if(i==0||D.rs[i]!=D.rs[i-1]||D.rd[i]<=minDepth[D.rs[i]])cur=i;\n"
+    "top[i]=cur;}\n"
+    "var view=document.getElementById('view'),rows=document.getElementById('rows'),spacer=document.getElementById('spacer');\n"
+    "var typeSel=document.getElementById('type'),types={};\n"
+    "for(i=0;i<N;i++)if(D.at[i]>=0)types[D.at[i]]=st[D.at[i]];\n"
+    "Object.keys(types).sort(function(a,b){return types[a]<types[b]?-1:1;}).forEach(function(t){\n"
+    "var o=document.createElement('option');o.value=t;o.textContent=types[t];typeSel.appendChild(o);});\n"
+    "var filter=document.getElementById('filter'),show=[document.getElementById('showAdd'),document.getElementById('showDel'),document.getElementById('showMod')];\n"
+    "var vis=[],low=null;\n"
+    "function has(x,f){return x>=0&&low[x].indexOf(f)>=0;}\n"
+
+    "function esc(s){return s.replace(/&/g,'&amp;').replace(/</g,'&lt;').replace(/>/g,'&gt;');}\n"
+    "function rebuild(){\n"
+    "var f=filter.value.toLowerCase(),ok=[show[0].checked,show[1].checked,show[2].checked],ty=+typeSel.value;\n"
+    "if(f&&!low)low=st.map(function(x){return x.toLowerCase();});\n"
+    "var lastSec=-1,hide=1e9,match=false;vis=[];\n"
+    "for(var i=0;i<N;i++){\n"
+    "if(top[i]==i){match=ok[D.rt[i]]&&(ty<0||D.at[i]==ty)&&(!f||has(D.rl[i],f)||has(D.rr[i],f));hide=1e9;}\n"
+    "if(!match)continue;\n"
+    "if(D.rd[i]>hide)continue;\n"
+    "hide=1e9;\n"
+    "if(D.rs[i]!=lastSec){vis.push(-D.rs[i]-1);lastSec=D.rs[i];}\n"
+    "vis.push(i);\n"
+    "if(kids[i]&&!open[i])hide=D.rd[i];}\n"
+    "spacer.style.height=(vis.length*H)+'px';\n"
+    "render();}\n"
+    "function render(){\n"
+    "var first=Math.max(0,Math.floor(view.scrollTop/H)-20),last=Math.min(vis.length,first+Math.ceil(view.clientHeight/H)+40),h='';\n"
+    "for(var k=first;k<last;k++){\n"
+    "var v=vis[k],y=k*H;\n"
+    "if(v<0){var s=-v-1,t=esc(st[D.sec[s]])+(D.cnt[s]>=0?' ('+D.cnt[s]+')':'');\n"
+    "h+='<div class=\"row sec\" style=\"top:'+y+'px\"><div>'+t+'</div><div>'+t+'</div></div>';continue;}\n"
+    "var pad='padding-left:'+(D.rd[v]*16)+'px',m=kids[v]?(open[v]?'\\u25BE ':'\\u25B8 '):'';\n"
+    "var l=D.rl[v]<0?'':m+esc(st[D.rl[v]]),r=D.rr[v]<0?'':m+esc(st[D.rr[v]]);\n"
+    "h+='<div class=\"row '+['add','del','mod'][D.rt[v]]+(kids[v]?' kid':'')+'\" data-i=\"'+v+'\" style=\"top:'+y+'px\">'\n"
+    "+'<div style=\"'+pad+'\">'+l+'</div><div style=\"'+pad+'\">'+r+'</div></div>';}\n"
+    "rows.innerHTML=h;}\n"
+    "function setAll(x){for(var i=0;i<N;i++)if(kids[i])open[i]=x;rebuild();}\n"
+    "rows.addEventListener('click',function(e){\n"
+    "var row=e.target.closest('.row');if(!row||!row.dataset.i)return;\n"
+    "var i=+row.dataset.i;if(!kids[i])return;open[i]=open[i]?0:1;rebuild();});\n"
+    "view.addEventListener('scroll',render);\n"
+    "window.addEventListener('resize',render);\n"
+    "filter.addEventListener('input',rebuild);\n"
+    "typeSel.addEventListener('change',rebuild);\n"
+    "for(i=0;i<3;i++)show[i].addEventListener('change',rebuild);\n"
+    "document.getElementById('expand').addEventListener('click',function(){setAll(1);});\n"
+    "document.getElementById('collapse').addEventListener('click',function(){setAll(0);});\n"
+    "document.getElementById('oname').textContent=D.o;\n"
+    "document.getElementById('mname').textContent=D.m;\n"
+    "document.getElementById('totals').textContent=D.tot[0]+' addition(s), '+D.tot[1]+' deletion(s), '+D.tot[2]+' modification(s)';\n"
+    "rebuild();\n"
+    "})();\n"
+    "</script>\n"
+    "</body>\n"
+    "</html>\n";
+
+HtmlSink::HtmlSink(OutputBuffer& out) : out(out)
+{
+}
+
+int HtmlSink::stringID(const char* str)
+{
+    auto it = stringIDs.find(str);
+    if (it != stringIDs.end()) return it->second;
+
+    int id = (int)strings.size();
+    strings.push_back(str);
+    stringIDs[strings.back()] = id;
+    return id;
+}
+
+void HtmlSink::writeJsonString(const char* str)
+{
+    out.writeChar('"');
+    for (const unsigned char* c = (const unsigned char*)str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            out.writeChar('\\');
+            out.writeChar(*c);
+        } else if (*c < 0x20 || *c >= 0x7F || *c == '<' || *c == '>') {
+            // Escaping < and > keeps "</script>" in a name from ending the script.
+            // HIP strings aren't guaranteed to be UTF-8, so treat bytes as Latin-1
+            out.writef("\\u%04X", *c);
+        } else {
+            out.writeChar(*c);
+        }
+    }
+    out.writeChar('"');
+}
+
+void HtmlSink::writeIntArray(const std::vector<int>& values)
+{
+    out.writeChar('[');
+    for (size_t i = 0; i < values.size(); i++) {
+        if (i) out.writeChar(',');
+        out.writef("%d", values[i]);
+    }
+    out.writeChar(']');
+}
+
+void HtmlSink::begin(const char* oname, const char* mname)
+{
+    this->oname = oname;
+    this->mname = mname;
+
+    strings.clear();
+    stringIDs.clear();
+    sectionTitles.clear();
+    sectionCounts.clear();
+    sectionStarts.clear();
+    rowTypes.clear();
+    rowDepths.clear();
+    rowLefts.clear();
+    rowRights.clear();
+    rowAssetTypes.clear();
+}
+
+void HtmlSink::section(const char* title, int count)
+{
+    sectionTitles.push_back(stringID(title));
+    sectionCounts.push_back(count);
+    sectionStarts.push_back((int)rowTypes.size());
+}
+
+void HtmlSink::diff(const Diff& diff)
+{
+    char buf[DIFF_TEXT_SIZE];
+
+    int left = -1;
+    int right = -1;
+    if (diff.type != Diff::Type::Addition) {
+        formatDiffSide(diff, true, buf, sizeof(buf));
+        left = stringID(buf + strspn(buf, " "));
+    }
+    if (diff.type != Diff::Type::Deletion) {
+        formatDiffSide(diff, false, buf, sizeof(buf));
+        right = stringID(buf + strspn(buf, " "));
+    }
+
+    int depth = diffDepth(diff);
+    if (depth > 9) depth = 9;
+
+    rowTypes.push_back((char)('0' + (int)diff.type));
+    rowDepths.push_back((char)('0' + depth));
+    rowLefts.push_back(left);
+    rowRights.push_back(right);
+
+    int assetType = -1;
+    if (diff.assetType) {
+        char fourCC[5];
+        for (int i = 0; i < 4; i++) fourCC[i] = (char)(diff.assetType >> (24 - i * 8));
+        fourCC[4] = '\0';
+        assetType = stringID(fourCC);
+    }
+    rowAssetTypes.push_back(assetType);
+}
+
+void HtmlSink::end(int additionCount, int deletionCount, int modificationCount)
+{
+    out.writeString(htmlHead);
+
+    // JSON rather than a script literal, browsers parse it much faster
+    out.writeString("<script type=\"application/json\" id=\"data\">\n{\"o\":");
+    writeJsonString(oname.c_str());
+    out.writeString(",\"m\":");
+    writeJsonString(mname.c_str());
+    out.writef(",\"tot\":[%d,%d,%d]", additionCount, deletionCount, modificationCount);
+
+    out.writeString(",\n\"st\":[");
+    for (size_t i = 0; i < strings.size(); i++) {
+        if (i) out.writeString(",\n");
+        writeJsonString(strings[i].c_str());
+    }
+    out.writeString("],\n\"sec\":");
+    writeIntArray(sectionTitles);
+    out.writeString(",\n\"cnt\":");
+    writeIntArray(sectionCounts);
+    out.writeString(",\n\"ss\":");
+    writeIntArray(sectionStarts);
+    out.writeString(",\n\"rt\":\"");
+    for (char t : rowTypes) out.writeChar(t);
+    out.writeString("\",\n\"rd\":\"");
+    for (char d : rowDepths) out.writeChar(d);
+    out.writeChar('"');
+    out.writeString(",\n\"rl\":");
+    writeIntArray(rowLefts);
+    out.writeString(",\n\"rr\":");
+    writeIntArray(rowRights);
+    out.writeString(",\n\"at\":");
+    writeIntArray(rowAssetTypes);
+    out.writeString("}\n</script>\n");
+
+    out.writeString(htmlScript);
+    out.flush();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "output.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A single self-contained HTML page. The diff is embedded as columnar arrays (one array
+// per field, strings deduplicated into a table) and drawn by a virtualized table, so
+// only the rows on screen exist in the page. Everything is written at end()
+class HtmlSink : public DiffSink
+{
+public:
+    HtmlSink(OutputBuffer& out);
+
+    void begin(const char* oname, const char* mname) override;
+    void section(const char* title, int count) override;
+    void diff(const Diff& diff) override;
+    void end(int additionCount, int deletionCount, int modificationCount) override;
+
+private:
+    OutputBuffer& out;
+
+    std::string oname;
+    std::string mname;
+
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, int> stringIDs;
+
+    std::vector<int> sectionTitles;
+    std::vector<int> sectionCounts;
+    std::vector<int> sectionStarts; // First row of each section
+
+    // Row columns
+    std::vector<char> rowTypes;  // '0' + Diff::Type
+    std::vector<char> rowDepths; // '0' + depth
+    std::vector<int> rowLefts;  // -1 if none
+    std::vector<int> rowRights; // -1 if none
+    std::vector<int> rowAssetTypes; // FourCC string, -1 for rows that aren't about an asset
+
+    int stringID(const char* str);
+    void writeJsonString(const char* str);
+    void writeIntArray(const std::vector<int>& values);
+};
@@ -0,0 +1,230 @@
+#include "inputfile.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+InputFile::InputFile() : readAhead(false), bytesRead(0), pos(0), current(nullptr), readIndex(0), fillIndex(0),
+                         fillPos(0), generation(0), atEnd(false), stopping(false)
+{
+    memset(&file, 0, sizeof(file));
+    memset(&direct, 0, sizeof(direct));
+    memset(buffers, 0, sizeof(buffers));
+}
+
+InputFile::~InputFile()
+{
+    close();
+}
+
+bool InputFile::open(const char* path, bool readAhead)
+{
+    close();
+
+    bool opened = strcmp(path, "-") ? ioOpenFile(path, &file) : ioOpenStdin(&file);
+    if (!opened) return false;
+
+    ioAdviseSequential(&file);
+    bytesRead = 0;
+    pos = 0;
+
+    // Keep draining a pipe while the parser works, so its writer isn't held up
+    if (file.isStream) readAhead = true;
+
+    this->readAhead = readAhead;
+    if (!readAhead) {
+        direct.data = (char*)malloc(INPUT_DIRECT_BUFFER_SIZE);
+        if (!direct.data) {
+            close();
+            return false;
+        }
+        direct.start = 0;
+        direct.size = 0;
+    } else {
+        for (Buffer& buffer : buffers) {
+            buffer.data = (char*)malloc(INPUT_BUFFER_SIZE);
+            if (!buffer.data) {
+                close();
+                return false;
+            }
+        }
+
+        restart(0);
+        stopping = false;
+        thread = std::thread(&InputFile::readerMain, this);
+    }
+
+    return true;
+}
+
+void InputFile::close()
+{
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cond.notify_all();
+        thread.join();
+    }
+
+    for (Buffer& buffer : buffers) {
+        free(buffer.data);
+        buffer.data = nullptr;
+        buffer.full = false;
+    }
+    free(direct.data);
+    direct.data = nullptr;
+    current = nullptr;
+
+    if (file.isOpen) {
+        ioDropCache(&file, 0, 0);
+        ioCountBytes(bytesRead);
+        bytesRead = 0;
+
+        ioCloseFile(&file);
+    }
+}
+
+bool InputFile::readsAhead() const
+{
+    return readAhead;
+}
+
+const IoFile* InputFile::handle() const
+{
+    return &file;
+}
+
+size_t InputFile::read(void* buf, size_t size)
+{
+    char* out = (char*)buf;
+    size_t total = 0;
+    while (total < size) {
+        if (!current || pos < current->start || pos - current->start >= current->size) {
+            if (!readAhead) {
+                // Large reads skip the buffer
+                if (size - total >= INPUT_DIRECT_BUFFER_SIZE) {
+                    size_t count = ioReadAt(&file, pos, out + total, size - total);
+                    bytesRead += count;
+                    total += count;
+                    pos += (uint32_t)count;
+                    break;
+                }
+
+                direct.start = pos;
+                direct.size = (uint32_t)ioReadAt(&file, pos, direct.data, INPUT_DIRECT_BUFFER_SIZE);
+                bytesRead += direct.size;
+                current = &direct;
+                if (direct.size == 0) break;
+            } else if (!fetch()) {
+                break;
+            }
+        }
+
+        size_t offset = pos - current->start;
+        size_t count = current->size - offset;
+        if (count > size - total) count = size - total;
+
+        memcpy(out + total, current->data + offset, count);
+        total += count;
+        pos += (uint32_t)count;
+    }
+    return total;
+}
+
+void InputFile::seek(uint32_t pos)
+{
+    // The buffers catch up on the next read
+    this->pos = pos;
+}
+
+uint32_t InputFile::tell() const
+{
+    return pos;
+}
+
+// Make current the buffer holding pos, handing consumed buffers back to the I/O thread.
+// Returns false at the end of the file
+bool InputFile::fetch()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    current = nullptr;
+
+    while (true) {
+        Buffer& buffer = buffers[readIndex];
+        cond.wait(lock, [&buffer]() { return buffer.full; });
+
+        if (pos < buffer.start) {
+            // What a stream already delivered is gone
+            if (file.isStream) return false;
+            restart(pos);
+            continue;
+        }
+        if (pos - buffer.start < buffer.size) {
+            current = &buffer;
+            return true;
+        }
+        if (buffer.last) {
+            return false;
+        }
+
+        buffer.full = false;
+        readIndex = (readIndex + 1) % INPUT_BUFFER_COUNT;
+        cond.notify_all();
+    }
+}
+
+// Drop all buffered data and read again from pos. Must be called with the mutex locked
+// (or before the I/O thread is started)
+void InputFile::restart(uint32_t pos)
+{
+    for (Buffer& buffer : buffers) buffer.full = false;
+    current = nullptr;
+    readIndex = 0;
+    fillIndex = 0;
+    fillPos = pos;
+    generation++;
+    atEnd = false;
+    cond.notify_all();
+}
+
+void InputFile::readerMain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait(lock, [this]() { return stopping || (!atEnd && !buffers[fillIndex].full); });
+        if (stopping) return;
+
+        Buffer& buffer = buffers[fillIndex];
+        uint32_t start = fillPos;
+        uint32_t startGeneration = generation;
+
+        // The buffer isn't full, so the consumer doesn't touch it while it's filled
+        lock.unlock();
+        size_t count;
+        bool last;
+        if (file.isStream) {
+            // Whatever has arrived, the parser can get going on it
+            count = ioRead(&file, buffer.data, INPUT_BUFFER_SIZE);
+            last = (count == 0);
+        } else {
+            count = ioReadAt(&file, start, buffer.data, INPUT_BUFFER_SIZE);
+            ioDropCache(&file, start, (uint32_t)count);
+            last = (count < INPUT_BUFFER_SIZE);
+        }
+        lock.lock();
+
+        bytesRead += count;
+
+        if (generation != startGeneration) continue;
+
+        buffer.start = start;
+        buffer.size = (uint32_t)count;
+        buffer.full = true;
+        buffer.last = last;
+        fillPos += (uint32_t)count;
+        fillIndex = (fillIndex + 1) % INPUT_BUFFER_COUNT;
+        if (last) atEnd = true;
+        cond.notify_all();
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "iobackend.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define INPUT_BUFFER_SIZE (8 * 1024 * 1024)
+#define INPUT_BUFFER_COUNT 2
+#define INPUT_DIRECT_BUFFER_SIZE (64 * 1024)
+
+// Sequential input for the parser. Either direct, reading small buffers on demand, or read
+// ahead: an I/O thread fills large buffers from the file while the parser consumes the
+// previous one. Seeking forward is cheap, seeking before the buffered data restarts the
+// I/O thread. The position belongs to the InputFile, all file reads are positioned, so other
+// threads can read the file through handle() at the same time.
+//
+// Pipes and standard input (a path of "-") always read ahead. The I/O thread hands each
+// chunk to the parser as it arrives, and only seeking forward works
+class InputFile
+{
+public:
+    InputFile();
+    ~InputFile();
+
+    bool open(const char* path, bool readAhead);
+    void close();
+
+    size_t read(void* buf, size_t size);
+    void seek(uint32_t pos);
+    uint32_t tell() const;
+
+    bool readsAhead() const;
+    const IoFile* handle() const;
+
+private:
+    struct Buffer
+    {
+        char* data;
+        uint32_t start; // File offset of data
+        uint32_t size;  // Less than INPUT_BUFFER_SIZE at the end of the file, or for a stream
+        bool full;      // Owned by the consumer when set, by the I/O thread otherwise
+        bool last;      // Nothing follows it in the file
+    };
+
+    IoFile file;
+    bool readAhead;
+    uint64_t bytesRead; // Added to ioBytesRead on close
+
+    // Consumer side
+    uint32_t pos;
+    Buffer* current; // Full buffer being consumed, read without locking
+    Buffer direct;   // Without read ahead
+
+    // Shared, guarded by mutex
+    Buffer buffers[INPUT_BUFFER_COUNT];
+    int readIndex;
+    int fillIndex;
+    uint32_t fillPos;
+    uint32_t generation; // Changes on restart, the I/O thread drops reads started before
+    bool atEnd;
+    bool stopping;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread thread;
+
+    bool fetch();
+    void restart(uint32_t pos);
+    void readerMain();
+};
@@ -0,0 +1,626 @@
+#include "iobackend.h"
+
+#include "largealloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define IO_HAVE_URING 1
+#endif
+
+// Size of a single read submitted to io_uring
+#define IO_CHUNK_SIZE (256 * 1024)
+
+static IoBackend ioBackend = IoBackend::Stdio;
+static int ioQueueDepth = IO_DEFAULT_QUEUE_DEPTH;
+static bool ioReadAhead = false;
+static bool ioCold = false;
+static std::atomic<uint64_t> ioByteCount(0);
+
+void setIoBackend(IoBackend backend)
+{
+    ioBackend = backend;
+}
+
+void setIoQueueDepth(int depth)
+{
+    if (depth < 1) depth = 1;
+    if (depth > IO_MAX_QUEUE_DEPTH) depth = IO_MAX_QUEUE_DEPTH;
+    ioQueueDepth = depth;
+}
+
+void setIoReadAhead(bool readAhead)
+{
+    ioReadAhead = readAhead;
+}
+
+bool getIoReadAhead()
+{
+    return ioReadAhead;
+}
+
+void setIoCold(bool cold)
+{
+    ioCold = cold;
+}
+
+#ifdef _WIN32
+
+bool ioOpenFile(const char* path, IoFile* file)
+{
+    memset(file, 0, sizeof(*file));
+
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (ioCold) flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, flags, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    file->handle = handle;
+    file->isOpen = true;
+    file->isStream = GetFileType(handle) != FILE_TYPE_DISK;
+    return true;
+}
+
+// A duplicate of the handle, so closing the file leaves stdin alone. Reading the handle
+// directly skips the CRT's text mode translation
+bool ioOpenStdin(IoFile* file)
+{
+    memset(file, 0, sizeof(*file));
+
+    HANDLE process = GetCurrentProcess();
+    HANDLE handle;
+    if (!DuplicateHandle(process, GetStdHandle(STD_INPUT_HANDLE), process, &handle, 0, FALSE, DUPLICATE_SAME_ACCESS)) return false;
+
+    file->handle = handle;
+    file->isOpen = true;
+    file->isStream = GetFileType(handle) != FILE_TYPE_DISK;
+    return true;
+}
+
+void ioCloseFile(IoFile* file)
+{
+    if (file->isOpen) CloseHandle((HANDLE)file->handle);
+    memset(file, 0, sizeof(*file));
+}
+
+bool ioFileSize(const IoFile* file, uint64_t* size)
+{
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx((HANDLE)file->handle, &fileSize)) return false;
+    *size = (uint64_t)fileSize.QuadPart;
+    return true;
+}
+
+// ReadFile with an offset in the OVERLAPPED reads there without using the handle's file
+// pointer, the Windows equivalent of pread
+size_t ioReadAt(const IoFile* file, uint64_t offset, void* buf, size_t size)
+{
+    size_t done = 0;
+    while (done < size) {
+        size_t left = size - done;
+        DWORD len = (left < 0x40000000) ? (DWORD)left : 0x40000000;
+
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = (DWORD)(offset + done);
+        overlapped.OffsetHigh = (DWORD)((offset + done) >> 32);
+
+        DWORD count = 0;
+        if (!ReadFile((HANDLE)file->handle, (char*)buf + done, len, &count, &overlapped) || count == 0) break;
+        done += count;
+    }
+    return done;
+}
+
+// A pipe's writer closing shows up as ERROR_BROKEN_PIPE, which ends the stream like any error
+size_t ioRead(const IoFile* file, void* buf, size_t size)
+{
+    DWORD len = (size < 0x40000000) ? (DWORD)size : 0x40000000;
+    DWORD count = 0;
+    if (!ReadFile((HANDLE)file->handle, buf, len, &count, NULL)) return 0;
+    return count;
+}
+
+#else
+
+// Anything but a regular file or block device has no offsets to pread at
+static bool isStreamFd(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) return true;
+    return !S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode);
+}
+
+bool ioOpenFile(const char* path, IoFile* file)
+{
+    memset(file, 0, sizeof(*file));
+
+    int fd;
+    do {
+        fd = open(path, O_RDONLY);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) return false;
+
+    file->fd = fd;
+    file->isOpen = true;
+    file->isStream = isStreamFd(fd);
+    return true;
+}
+
+// A duplicate of the descriptor, so closing the file leaves stdin alone
+bool ioOpenStdin(IoFile* file)
+{
+    memset(file, 0, sizeof(*file));
+
+    int fd = dup(STDIN_FILENO);
+    if (fd < 0) return false;
+
+    file->fd = fd;
+    file->isOpen = true;
+    file->isStream = isStreamFd(fd);
+    return true;
+}
+
+void ioCloseFile(IoFile* file)
+{
+    if (file->isOpen) close(file->fd);
+    memset(file, 0, sizeof(*file));
+}
+
+bool ioFileSize(const IoFile* file, uint64_t* size)
+{
+    struct stat st;
+    if (fstat(file->fd, &st) != 0) return false;
+    *size = (uint64_t)st.st_size;
+    return true;
+}
+
+size_t ioReadAt(const IoFile* file, uint64_t offset, void* buf, size_t size)
+{
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(file->fd, (char*)buf + done, size - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    return done;
+}
+
+size_t ioRead(const IoFile* file, void* buf, size_t size)
+{
+    while (true) {
+        ssize_t n = read(file->fd, buf, size);
+        if (n < 0 && errno == EINTR) continue;
+        return (n > 0) ? (size_t)n : 0;
+    }
+}
+
+#endif
+
+// posix_fadvise is missing on some platforms (macOS). On Windows, files are opened with
+// the sequential scan hint instead and there's nothing to drop
+void ioAdviseSequential(const IoFile* file)
+{
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (ioCold) posix_fadvise(file->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+    (void)file;
+#endif
+}
+
+void ioDropCache(const IoFile* file, uint32_t offset, uint32_t size)
+{
+#ifdef POSIX_FADV_DONTNEED
+    if (ioCold) posix_fadvise(file->fd, offset, size, POSIX_FADV_DONTNEED);
+#else
+    (void)file;
+    (void)offset;
+    (void)size;
+#endif
+}
+
+void ioCountBytes(uint64_t count)
+{
+    ioByteCount.fetch_add(count, std::memory_order_relaxed);
+}
+
+uint64_t ioBytesRead()
+{
+    return ioByteCount.load(std::memory_order_relaxed);
+}
+
+bool parseIoBackend(const char* name, IoBackend* backend)
+{
+    if (!strcmp(name, "stdio")) *backend = IoBackend::Stdio;
+    else if (!strcmp(name, "mmap")) *backend = IoBackend::Mmap;
+    else if (!strcmp(name, "uring")) *backend = IoBackend::Uring;
+    else return false;
+    return true;
+}
+
+bool ioAllocRegion(uint32_t size, IoRegion* region)
+{
+    memset(region, 0, sizeof(*region));
+
+    // Never zero sized, data must be a valid pointer even for an empty DPAK
+    region->baseSize = size ? size : 1;
+    region->base = largeAlloc(region->baseSize);
+    if (!region->base) return false;
+
+    region->data = (char*)region->base;
+    region->mapped = false;
+    return true;
+}
+
+static bool readStdio(const IoFile* file, uint32_t offset, uint32_t size, IoRegion* region)
+{
+    if (!ioAllocRegion(size, region)) return false;
+
+    if (ioReadAt(file, offset, region->data, size) != size) {
+        ioFreeRegion(region);
+        return false;
+    }
+    return true;
+}
+
+#ifdef _WIN32
+
+static bool mapRegion(const IoFile* file, uint32_t offset, uint32_t size, IoRegion* region)
+{
+    HANDLE handle = (HANDLE)file->handle;
+
+    // Accessing a view past the end of the file faults, reject the range instead
+    uint64_t fileSize;
+    if (!ioFileSize(file, &fileSize) || (uint64_t)offset + size > fileSize) return false;
+
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    uint32_t start = offset - offset % info.dwAllocationGranularity;
+    size_t mapSize = (size_t)(offset - start) + size;
+
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (!mapping) return false;
+
+    // The view keeps the mapping alive
+    void* base = MapViewOfFile(mapping, FILE_MAP_COPY, 0, start, mapSize);
+    CloseHandle(mapping);
+    if (!base) return false;
+
+    region->base = base;
+    region->baseSize = mapSize;
+    region->data = (char*)base + (offset - start);
+    region->mapped = true;
+    return true;
+}
+
+#else
+
+static bool mapRegion(const IoFile* file, uint32_t offset, uint32_t size, IoRegion* region)
+{
+    int fd = file->fd;
+
+    // Accessing a mapping past the end of the file raises SIGBUS, reject the range instead
+    uint64_t fileSize;
+    if (!ioFileSize(file, &fileSize) || (uint64_t)offset + size > fileSize) return false;
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = offset - offset % page;
+    size_t mapSize = (offset - start) + size;
+
+    void* base = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)start);
+    if (base == MAP_FAILED) return false;
+
+    region->base = base;
+    region->baseSize = mapSize;
+    region->data = (char*)base + (offset - start);
+    region->mapped = true;
+    return true;
+}
+
+#endif
+
+#ifdef IO_HAVE_URING
+
+// Minimal io_uring setup through the raw syscalls, so there's no liburing dependency
+struct Uring
+{
+    int fd;
+    unsigned entries;
+
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned* sqArray;
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+};
+
+static int uringSetup(unsigned entries, struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static void uringClose(Uring* ring)
+{
+    if (ring->sqes) munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing && ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+    if (ring->sqRing) munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->fd);
+}
+
+static bool uringOpen(Uring* ring, unsigned entries)
+{
+    memset(ring, 0, sizeof(*ring));
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = uringSetup(entries, &params);
+    if (ring->fd < 0) return false;
+
+    ring->entries = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    // Newer kernels map both rings with one call
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap) {
+        if (ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+
+    void* sqRing = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        uringClose(ring);
+        return false;
+    }
+    ring->sqRing = sqRing;
+
+    if (singleMap) {
+        ring->cqRing = sqRing;
+    } else {
+        void* cqRing = mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            uringClose(ring);
+            return false;
+        }
+        ring->cqRing = cqRing;
+    }
+
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        uringClose(ring);
+        return false;
+    }
+    ring->sqes = (struct io_uring_sqe*)sqes;
+
+    char* sq = (char*)ring->sqRing;
+    ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+
+    char* cq = (char*)ring->cqRing;
+    ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+static void uringQueueRead(Uring* ring, int fd, bool fixed, char* buf, uint64_t fileOffset, uint32_t pos, uint32_t len)
+{
+    // Only this thread writes the tail, the kernel reads it
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & ring->sqMask;
+
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->off = fileOffset + pos;
+    sqe->addr = (uint64_t)(uintptr_t)(buf + pos);
+    sqe->len = len;
+    sqe->buf_index = 0;
+    sqe->user_data = ((uint64_t)pos << 32) | len;
+
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// Read the range as IO_CHUNK_SIZE reads with up to the queue depth in flight. Returns
+// false if anything failed, the caller then retries with pread
+static bool uringReadAll(int fd, char* buf, uint32_t offset, uint32_t size)
+{
+    Uring ring;
+    if (!uringOpen(&ring, (unsigned)ioQueueDepth)) return false;
+
+    // Registering the buffer saves the kernel mapping its pages for every read. This fails
+    // if the buffer is over the locked memory limit, plain reads are used then
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    bool fixed = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+
+    std::vector<std::pair<uint32_t, uint32_t>> retries; // Rest of short reads as (pos, len)
+    uint32_t next = 0;
+    uint32_t done = 0;
+    unsigned queued = 0;   // In the submission queue, not yet submitted
+    unsigned inFlight = 0; // Submitted, not yet completed
+    bool ok = true;
+
+    while (ok && done < size) {
+        while (queued + inFlight < ring.entries) {
+            uint32_t pos, len;
+            if (!retries.empty()) {
+                pos = retries.back().first;
+                len = retries.back().second;
+                retries.pop_back();
+            } else if (next < size) {
+                pos = next;
+                len = (size - next < IO_CHUNK_SIZE) ? size - next : IO_CHUNK_SIZE;
+                next += len;
+            } else {
+                break;
+            }
+            uringQueueRead(&ring, fd, fixed, buf, offset, pos, len);
+            queued++;
+        }
+
+        int submitted = uringEnter(ring.fd, queued, 1, IORING_ENTER_GETEVENTS);
+        if (submitted < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        queued -= (unsigned)submitted;
+        inFlight += (unsigned)submitted;
+
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe& cqe = ring.cqes[head & ring.cqMask];
+            uint32_t pos = (uint32_t)(cqe.user_data >> 32);
+            uint32_t len = (uint32_t)cqe.user_data;
+            inFlight--;
+
+            if (cqe.res == -EAGAIN || cqe.res == -EINTR) {
+                retries.push_back(std::make_pair(pos, len));
+            } else if (cqe.res <= 0) {
+                ok = false; // Error, or end of file before the end of the range
+            } else if ((uint32_t)cqe.res < len) {
+                done += (uint32_t)cqe.res;
+                retries.push_back(std::make_pair(pos + (uint32_t)cqe.res, len - (uint32_t)cqe.res));
+            } else {
+                done += len;
+            }
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    // Reads still in flight write into the buffer, wait for them before it can be freed
+    while (inFlight > 0) {
+        if (uringEnter(ring.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) break;
+
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        inFlight -= tail - head;
+        __atomic_store_n(ring.cqHead, tail, __ATOMIC_RELEASE);
+    }
+
+    uringClose(&ring);
+    return ok;
+}
+
+bool ioUringAvailable()
+{
+    static int available = -1;
+    if (available == -1) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int fd = uringSetup(1, &params);
+        available = (fd >= 0);
+        if (fd >= 0) close(fd);
+    }
+    return available == 1;
+}
+
+#else
+
+bool ioUringAvailable()
+{
+    return false;
+}
+
+#endif
+
+static bool readUring(const IoFile* file, uint32_t offset, uint32_t size, IoRegion* region)
+{
+#ifndef IO_HAVE_URING
+    // No io_uring here, the plain reads are already positioned
+    return readStdio(file, offset, size, region);
+#else
+    if (!ioAllocRegion(size, region)) return false;
+
+    bool ok = ioUringAvailable() && uringReadAll(file->fd, region->data, offset, size);
+    if (!ok) ok = ioReadAt(file, offset, region->data, size) == size;
+
+    if (!ok) ioFreeRegion(region);
+    return ok;
+#endif
+}
+
+bool ioReadRegion(const IoFile* file, uint32_t offset, uint32_t size, IoRegion* region)
+{
+    memset(region, 0, sizeof(*region));
+
+    bool loaded;
+    switch (ioBackend) {
+    case IoBackend::Mmap:
+        // Nothing to map for an empty range
+        if (size == 0) return ioAllocRegion(size, region);
+        loaded = mapRegion(file, offset, size, region);
+        break;
+    case IoBackend::Uring:
+        loaded = readUring(file, offset, size, region);
+        break;
+    default:
+        loaded = readStdio(file, offset, size, region);
+        break;
+    }
+    if (!loaded) return false;
+
+    ioCountBytes(size);
+    if (!region->mapped) ioDropCache(file, offset, size);
+    return true;
+}
+
+void ioFreeRegion(IoRegion* region)
+{
+    if (region->base) {
+        if (!region->mapped) {
+            largeFree(region->base, region->baseSize);
+        } else {
+#ifdef _WIN32
+            UnmapViewOfFile(region->base);
+#else
+            munmap(region->base, region->baseSize);
+#endif
+        }
+    }
+    memset(region, 0, sizeof(*region));
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IO_DEFAULT_QUEUE_DEPTH 32
+#define IO_MAX_QUEUE_DEPTH 4096
+
+// How bulk file data (the DPAK asset data) is brought into memory
+enum class IoBackend
+{
+    Stdio, // Plain reads into a heap buffer
+    Mmap,  // Copy-on-write mapping of the file
+    Uring  // Batched positioned reads through io_uring, pread where it's unavailable
+};
+
+// Must be set before files are read
+void setIoBackend(IoBackend backend);
+
+// Number of reads the uring backend keeps in flight per file
+void setIoQueueDepth(int depth);
+
+bool parseIoBackend(const char* name, IoBackend* backend);
+
+// Parse files while an I/O thread reads ahead of the parser (see InputFile). Asset data then
+// streams through the read-ahead buffers instead of the backend
+void setIoReadAhead(bool readAhead);
+bool getIoReadAhead();
+
+// Stream files past the OS page cache instead of through it: reads are hinted as
+// sequential and dropped from the cache once they've been copied out. Mapped data (the
+// mmap backend) stays cached
+void setIoCold(bool cold);
+
+// A file opened for positioned reads. Every read carries its own offset and there's no
+// file position, so any number of threads can read the same file at once. Zero initialized
+// means closed
+struct IoFile
+{
+#ifdef _WIN32
+    void* handle; // HANDLE
+#else
+    int fd;
+#endif
+    bool isOpen;
+    bool isStream; // Pipe, terminal or socket: only ioRead works, the data arrives in order
+};
+
+bool ioOpenFile(const char* path, IoFile* file);
+bool ioOpenStdin(IoFile* file);
+void ioCloseFile(IoFile* file);
+bool ioFileSize(const IoFile* file, uint64_t* size);
+
+// Read up to size bytes at offset. Returns the number of bytes read, short only at the end
+// of the file or on an error
+size_t ioReadAt(const IoFile* file, uint64_t offset, void* buf, size_t size);
+
+// Read the next bytes of a stream, returning as soon as any have arrived. Returns 0 at the
+// end of the stream or on an error
+size_t ioRead(const IoFile* file, void* buf, size_t size);
+
+// Hints for the file if cold reads are enabled. A size of 0 means to the end of the file
+void ioAdviseSequential(const IoFile* file);
+void ioDropCache(const IoFile* file, uint32_t offset, uint32_t size);
+
+// Total bytes read (or mapped) from files by all threads
+void ioCountBytes(uint64_t count);
+uint64_t ioBytesRead();
+
+// False if the kernel doesn't support io_uring or it's disabled (the uring backend
+// then falls back to pread)
+bool ioUringAvailable();
+
+// A range of a file loaded by one of the backends. Zero initialized means empty
+struct IoRegion
+{
+    char* data;
+
+    void* base;      // largeAlloc block or start of the mapping
+    size_t baseSize; // Size of the block or mapping
+    bool mapped;
+};
+
+// Load size bytes at offset into region. The data is writable, but writes never reach the file.
+// Safe to call from several threads on the same file
+bool ioReadRegion(const IoFile* file, uint32_t offset, uint32_t size, IoRegion* region);
+void ioFreeRegion(IoRegion* region);
+
+// Heap allocated region for data read some other way
+bool ioAllocRegion(uint32_t size, IoRegion* region);
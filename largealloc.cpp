@@ -0,0 +1,141 @@
+#include "largealloc.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+static HugePages hugePages = HugePages::Off;
+
+#ifdef _WIN32
+
+// Large pages need the lock pages in memory privilege, which is only granted by policy
+static bool enableLockMemoryPrivilege()
+{
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return false;
+
+    TOKEN_PRIVILEGES privileges;
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    bool enabled = LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid)
+        && AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL)
+        && GetLastError() == ERROR_SUCCESS;
+
+    CloseHandle(token);
+    return enabled;
+}
+
+static bool largePagesEnabled = false;
+
+#endif
+
+void setHugePages(HugePages mode)
+{
+    hugePages = mode;
+#ifdef _WIN32
+    if (mode == HugePages::Pool) largePagesEnabled = enableLockMemoryPrivilege();
+#endif
+}
+
+bool parseHugePages(const char* name, HugePages* mode)
+{
+    if (!strcmp(name, "off")) *mode = HugePages::Off;
+    else if (!strcmp(name, "thp")) *mode = HugePages::Transparent;
+    else if (!strcmp(name, "pool")) *mode = HugePages::Pool;
+    else return false;
+    return true;
+}
+
+static size_t roundUp(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// Small allocations stay on the heap whatever the mode, so allocating and freeing agree
+// from the size alone
+static bool isLarge(size_t size)
+{
+    return hugePages != HugePages::Off && size >= HUGE_PAGE_SIZE;
+}
+
+#ifdef _WIN32
+
+void* largeAlloc(size_t size)
+{
+    if (!isLarge(size)) return malloc(size);
+
+    if (hugePages == HugePages::Pool && largePagesEnabled) {
+        size_t pageSize = GetLargePageMinimum();
+        if (pageSize) {
+            void* ptr = VirtualAlloc(NULL, roundUp(size, pageSize), MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (ptr) return ptr;
+        }
+    }
+
+    // No transparent huge pages on Windows, but freeing has to match
+    return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+void largeFree(void* ptr, size_t size)
+{
+    if (!ptr) return;
+
+    if (!isLarge(size)) {
+        free(ptr);
+        return;
+    }
+    VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
+#else
+
+void* largeAlloc(size_t size)
+{
+    if (!isLarge(size)) return malloc(size);
+
+    size_t rounded = roundUp(size, HUGE_PAGE_SIZE);
+
+#ifdef MAP_HUGETLB
+    if (hugePages == HugePages::Pool) {
+        void* ptr = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) return ptr;
+    }
+#endif
+
+    // Map one huge page extra and trim it so the buffer starts on a huge page boundary,
+    // otherwise its first and last pages can't be huge
+    size_t mapSize = rounded + HUGE_PAGE_SIZE;
+    void* raw = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return nullptr;
+
+    char* start = (char*)raw;
+    char* aligned = (char*)roundUp((uintptr_t)start, HUGE_PAGE_SIZE);
+    char* end = start + mapSize;
+    if (aligned > start) munmap(start, aligned - start);
+    if (end > aligned + rounded) munmap(aligned + rounded, end - (aligned + rounded));
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, rounded, MADV_HUGEPAGE);
+#endif
+    return aligned;
+}
+
+void largeFree(void* ptr, size_t size)
+{
+    if (!ptr) return;
+
+    if (!isLarge(size)) {
+        free(ptr);
+        return;
+    }
+    munmap(ptr, roundUp(size, HUGE_PAGE_SIZE));
+}
+
+#endif
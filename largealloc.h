@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// What backs allocations of HUGE_PAGE_SIZE or more
+enum class HugePages
+{
+    Off,         // Regular heap
+    Transparent, // 2 MB aligned and marked for transparent huge pages (Linux)
+    Pool         // Reserved huge pages (Linux hugetlb pool, Windows large pages), Transparent if none are free
+};
+
+// Must be set before anything is allocated with largeAlloc
+void setHugePages(HugePages mode);
+bool parseHugePages(const char* name, HugePages* mode);
+
+// Allocation for large, long lived buffers. Not zeroed. Must be freed with largeFree and
+// the same size
+void* largeAlloc(size_t size);
+void largeFree(void* ptr, size_t size);
@@ -1,4 +1,20 @@
 #include "hip.h"
+#include "decoder.h"
+#include "export.h"
+#include "hash.h"
+#include "html.h"
+#include "iobackend.h"
+#include "largealloc.h"
+#include "myers.h"
+#include "reloc.h"
+#include "store.h"
+#include "textdiff.h"
+#include "tui.h"
+#include "output.h"
+#include "parallel.h"
+#include "platform.h"
+#include "validate.h"
+#include "watch.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -7,12 +23,23 @@
 #include <assert.h>
 
 #include <vector>
+#include <string>
 #include <map>
 #include <unordered_map>
 #include <unordered_set>
+#include <deque>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <mutex>
 
 #ifdef _WIN32
 #include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <direct.h>
+#else
+#include <sys/stat.h>
 #endif
 
 #define VERSION "v1.0"
@@ -21,21 +48,71 @@
 
 static int columnWidth = DEFAULT_COLUMN_WIDTH;
 
+static bool assetDiffsOnly = false;
+static bool detailedAssets = false;
+static bool ignoreDataIfChksumMatch = false;
+static bool diffOffsets = false;
+static bool diffPluses = false;
+static bool watchMode = false;
+static int topCount = 0;
+static bool summaryMode = false;
+static bool tuiMode = false;
+static bool validateMode = false;
+static bool verifyChecksums = false;
+static bool diffOrder = false;
+static bool ioStats = false;
+static bool mappedIo = false; // --io mmap
+static bool gitDiffMode = false;
+static bool textconvMode = false;
+static const char* cacheDir = nullptr;
+static bool levelMode = false;
+static bool overlayMode = false;
+static const char* storeDir = nullptr;
+static bool storeIngestMode = false;
+static bool storeRestoreMode = false;
+static bool compareHashes = false; // Compare asset data by oassetHashes/massetHashes
+static RelocTable relocTable;
+static DecoderRegistry decoders;
+static bool detectText = false;
+static std::unordered_set<uint32_t> textTypes;
+
+enum class OutputFormat
+{
+    Columns,
+    Unified,
+    Json,
+    Binary,
+    Html
+};
+
+static OutputFormat outputFormat = OutputFormat::Columns;
+static const char* outputPath = nullptr; // stdout if not set
+static const char* exportPrefix = nullptr;
+static ExportFormat exportFormat = ExportFormat::Csv;
+
 static int additionCount = 0;
 static int deletionCount = 0;
 static int modificationCount = 0;
 static bool countsEnabled = true;
-
-struct Diff
+static uint32_t diffAssetType = 0; // Given to the diffs made while this asset type is diffed
+static bool headersPrinted = false; // Header sections were diffed and printed while the files were being read
+
+static int numAssetsAdded = 0;
+static int numAssetsDeleted = 0;
+static int numAssetsModified = 0;
+static int numLayersAdded = 0;
+static int numLayersDeleted = 0;
+static int numLayersModified = 0;
+static int numStaleChecksums = 0;
+static int numAssetsReordered = 0;
+static int numLayersReordered = 0;
+static int numAssetsMoved = 0;
+static int numArchiveMoves = 0;
+
+struct Index
 {
-    enum class Type
-    {
-        Addition,
-        Deletion,
-        Modification
-    } type;
-    char left[64];
-    char right[64];
+    int oidx = -1;
+    int midx = -1;
 };
 
 static std::vector<Diff> pverDiffs;
@@ -45,20 +122,43 @@ static std::vector<Diff> pcrtDiffs;
 static std::vector<Diff> pmodDiffs;
 static std::vector<Diff> platDiffs;
 static std::vector<Diff> ainfDiffs;
+static std::vector<Diff> staleChecksumDiffs;
 static std::vector<Diff> assetAdditions;
 static std::vector<Diff> assetDeletions;
 static std::vector<Diff> assetModifications;
 static std::vector<Diff> layerAdditions;
 static std::vector<Diff> layerDeletions;
 static std::vector<Diff> layerModifications;
+static std::vector<Diff> layerMoves;
+static std::vector<Diff> assetTopChanges;
+static std::deque<std::string> decodedStrings; // Storage for decoder diff strings
+static std::vector<Index> modifiedAssets; // In the order of assetModifications, without -d
+static std::vector<Diff> assetOrderDiffs;
+static std::vector<Diff> layerOrderDiffs;
+static std::vector<Diff> archiveMoves;
+
+// In level and overlay mode each side is several archives combined, with the archive each
+// asset resolved from and each layer came from. Empty otherwise
+struct ArchiveSources
+{
+    std::vector<uint32_t> assets; // Indices into archiveNames
+    std::vector<uint32_t> layers;
+};
+
+static ArchiveSources oarchiveSources;
+static ArchiveSources marchiveSources;
+static std::vector<std::string> archiveNames; // Shared by both sides, so equal names are the same archive
+static const char* archiveMovesTitle = "Moved between archives";
 
 template <class T = std::nullptr_t>
 static void ADDITION(std::vector<Diff>& diffs, const char* fmt, T val = T())
 {
     Diff diff;
     diff.type = Diff::Type::Addition;
-    diff.left[0] = '\0';
-    sprintf_s(diff.right, sizeof(diff.right), fmt, val);
+    diff.fmt = fmt;
+    diff.left = diffValue(nullptr);
+    diff.right = diffValue(val);
+    diff.assetType = diffAssetType;
     diffs.push_back(diff);
     if (countsEnabled) additionCount++;
 }
@@ -68,8 +168,10 @@ static void DELETION(std::vector<Diff>& diffs, const char* fmt, T val = T())
 {
     Diff diff;
     diff.type = Diff::Type::Deletion;
-    sprintf_s(diff.left, sizeof(diff.left), fmt, val);
-    diff.right[0] = '\0';
+    diff.fmt = fmt;
+    diff.left = diffValue(val);
+    diff.right = diffValue(nullptr);
+    diff.assetType = diffAssetType;
     diffs.push_back(diff);
     if (countsEnabled) deletionCount++;
 }
@@ -79,68 +181,159 @@ static void MODIFICATION(std::vector<Diff>& diffs, const char* fmt, T left = T()
 {
     Diff diff;
     diff.type = Diff::Type::Modification;
-    sprintf_s(diff.left, sizeof(diff.left), fmt, left);
-    sprintf_s(diff.right, sizeof(diff.right), fmt, right);
+    diff.fmt = fmt;
+    diff.left = diffValue(left);
+    diff.right = diffValue(right);
+    diff.assetType = diffAssetType;
     diffs.push_back(diff);
     if (countsEnabled) modificationCount++;
 }
 
-// https://stackoverflow.com/questions/3585846/color-text-in-terminal-applications-in-unix
-#define RED   "\x1B[31m"
-#define GRN   "\x1B[32m"
-#define YEL   "\x1B[33m"
-#define BLU   "\x1B[34m"
-#define MAG   "\x1B[35m"
-#define CYN   "\x1B[36m"
-#define WHT   "\x1B[37m"
-#define RESET "\x1B[0m"
+// Asset changes ranked by byte impact for --top, kept in a min-heap of at most topCount entries
+struct TopChange
+{
+    uint64_t impact;
+    uint32_t id;
+    Diff::Type type;
+    int oidx;
+    int midx;
+};
+
+static std::vector<TopChange> topChanges;
 
-static void printDiffLine(const char* left, const char* right)
+static bool isLargerChange(const TopChange& a, const TopChange& b)
 {
-    char bufFmt[16];
-    sprintf_s(bufFmt, sizeof(bufFmt), "%%-%ds", columnWidth);
-    printf(bufFmt, left);
-    printf(bufFmt, right);
-    printf("\n");
+    if (a.impact != b.impact) return a.impact > b.impact;
+    return a.id < b.id;
 }
 
-static void printDiffHeader(const char* left, const char* right)
+static void pushTopChange(Diff::Type type, uint32_t id, int oidx, int midx, uint64_t impact)
 {
-    printDiffLine(left, right);
-    for (int i = 0; i < columnWidth * 2; i++) printf("=");
-    printf("\n");
+    TopChange change;
+    change.impact = impact;
+    change.id = id;
+    change.type = type;
+    change.oidx = oidx;
+    change.midx = midx;
+
+    if ((int)topChanges.size() < topCount) {
+        topChanges.push_back(change);
+        std::push_heap(topChanges.begin(), topChanges.end(), isLargerChange);
+    } else if (isLargerChange(change, topChanges.front())) {
+        std::pop_heap(topChanges.begin(), topChanges.end(), isLargerChange);
+        topChanges.back() = change;
+        std::push_heap(topChanges.begin(), topChanges.end(), isLargerChange);
+    }
+}
+
+static uint32_t countChangedBytes(const char* a, const char* b, uint32_t size)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        if (a[i] != b[i]) count++;
+    }
+    return count;
+}
+
+static void resetDiffs()
+{
+    pverDiffs.clear();
+    pflgDiffs.clear();
+    pcntDiffs.clear();
+    pcrtDiffs.clear();
+    pmodDiffs.clear();
+    platDiffs.clear();
+    ainfDiffs.clear();
+    staleChecksumDiffs.clear();
+    assetAdditions.clear();
+    assetDeletions.clear();
+    assetModifications.clear();
+    layerAdditions.clear();
+    layerDeletions.clear();
+    layerModifications.clear();
+    layerMoves.clear();
+    assetTopChanges.clear();
+    decodedStrings.clear();
+    modifiedAssets.clear();
+    assetOrderDiffs.clear();
+    layerOrderDiffs.clear();
+    archiveMoves.clear();
+
+    additionCount = 0;
+    deletionCount = 0;
+    modificationCount = 0;
+
+    numAssetsAdded = 0;
+    numAssetsDeleted = 0;
+    numAssetsModified = 0;
+    numLayersAdded = 0;
+    numLayersDeleted = 0;
+    numLayersModified = 0;
+    numStaleChecksums = 0;
+    numAssetsReordered = 0;
+    numLayersReordered = 0;
+    numAssetsMoved = 0;
+    numArchiveMoves = 0;
+
+    topChanges.clear();
 }
 
-static void printDiff(const Diff& diff)
+// Asset data hashes, used instead of comparing data directly in watch mode and with
+// the --git-diff cache
+struct AssetHash
+{
+    uint32_t offset;
+    uint32_t size;
+    uint32_t checksum;
+    uint64_t hash;
+};
+
+static std::unordered_map<uint32_t, AssetHash> oassetHashes;
+static std::unordered_map<uint32_t, AssetHash> massetHashes;
+
+// Hash the data of every asset, reusing the previous hash of assets whose offset,
+// size and checksum are unchanged since the last load. Returns the number of assets hashed
+static int updateAssetHashes(Hip& hip, std::unordered_map<uint32_t, AssetHash>& hashes)
 {
-    switch (diff.type) {
-    case Diff::Type::Addition:
-        printf(GRN);
-        break;
-    case Diff::Type::Deletion:
-        printf(RED);
-        break;
-    case Diff::Type::Modification:
-        printf(YEL);
-        break;
+    std::unordered_map<uint32_t, AssetHash> prevHashes;
+    prevHashes.swap(hashes);
+    hashes.reserve(hip.pcnt.assetCount);
+
+    int hashCount = 0;
+    for (uint32_t i = 0; i < hip.pcnt.assetCount; i++) {
+        Hip::AHDR& ahdr = hip.ahdr[i];
+        Hip::ADBG& adbg = hip.adbg[i];
+
+        auto it = prevHashes.find(ahdr.id);
+        if (it != prevHashes.end()
+         && it->second.offset == ahdr.offset
+         && it->second.size == ahdr.size
+         && it->second.checksum == adbg.checksum) {
+            hashes[ahdr.id] = it->second;
+            continue;
+        }
+
+        AssetHash h;
+        h.offset = ahdr.offset;
+        h.size = ahdr.size;
+        h.checksum = adbg.checksum;
+        h.hash = relocTable.hashData(ahdr);
+        hashes[ahdr.id] = h;
+        hashCount++;
     }
-    printDiffLine(diff.left, diff.right);
-    printf(RESET);
+
+    return hashCount;
 }
 
-static void printDiffs(const std::vector<Diff>& diffs, const char* title, int count = -1) {
+#define CLEAR "\x1B[2J\x1B[H"
+
+static void printDiffs(DiffSink& sink, const std::vector<Diff>& diffs, const char* title, int count = -1) {
     if (!diffs.empty()) {
         if (title) {
-            if (count == -1) {
-                printDiffLine(title, title);
-            } else {
-                char buf[64];
-                sprintf_s(buf, sizeof(buf), "%s (%d)", title, count);
-                printDiffLine(buf, buf);
-            }
+            sink.section(title, count);
         }
         for (const Diff& diff : diffs) {
-            printDiff(diff);
+            sink.diff(diff);
         }
     }
 }
@@ -191,7 +384,15 @@ static void printVersion()
 static void printUsage()
 {
     printf("Usage:\n");
-    printf("    hipdiff [-h] [-v] [-a] [-d] [-c] [-o] [-p] [-w <width>] <original HIP file> <modified HIP file>\n");
+    printf("    hipdiff [-h] [-v] [-a] [-d] [-c] [-o] [-p] [-w <width>] [-f <format>] [--html <file>] [-j <threads>] [--io <backend>] [--io-depth <n>] [--read-ahead] [--cold] [--io-stats] [--huge-pages <mode>] [--top <n>] [--reloc <file>] [--plugin <file>] [--text] [--text-types <types>] [--summary] [--export <prefix>] [--export-format <format>] [--tui] [--verify] [--order] [--watch] <original HIP file> <modified HIP file>\n");
+    printf("    hipdiff --validate [-j <threads>] [--io <backend>] [--io-depth <n>] [--read-ahead] [--cold] [--io-stats] <HIP file>...\n");
+    printf("    hipdiff --level [diff options] <original HIP file> [<original HOP file>] <modified HIP file> [<modified HOP file>]\n");
+    printf("    hipdiff --overlay [diff options] <original archive>[,<archive>...] <modified archive>[,<archive>...]\n");
+    printf("    hipdiff --store <dir> --ingest <version> <HIP file>\n");
+    printf("    hipdiff --store <dir> --restore <version> <output file>\n");
+    printf("    hipdiff --store <dir> [diff options] <original version> <modified version>\n");
+    printf("    hipdiff --git-diff [--cache <dir>] [diff options] <git external diff arguments>\n");
+    printf("    hipdiff --textconv [-o] [-p] [--reloc <file>] <HIP file>\n");
     printf("\n");
     printf("Options:\n");
     printf("    -h: Show help\n");
@@ -202,184 +403,438 @@ static void printUsage()
     printf("    -o: Diff asset offsets\n");
     printf("    -p: Diff asset pluses\n");
     printf("    -w <width>: Set column width (default: %d)\n", DEFAULT_COLUMN_WIDTH);
+    printf("    -f <format>: Output format: columns (default), unified, json, binary or html\n");
+    printf("    --html <file>: Write the diff to a self-contained HTML report\n");
+    printf("    -j <threads>: Number of threads for parallel passes (default: one per core)\n");
+    printf("    --io <backend>: How asset data is read: stdio (default), mmap (not with --watch) or uring (io_uring, pread if unavailable)\n");
+    printf("    --io-depth <n>: Number of reads the uring backend keeps in flight (default: %d)\n", IO_DEFAULT_QUEUE_DEPTH);
+    printf("    --read-ahead: Read files on a separate thread ahead of parsing (asset data doesn't use --io then)\n");
+    printf("    --cold: Keep files that were read out of the OS file cache, for scanning many large files\n");
+    printf("    --io-stats: Report read throughput and compare time on stderr (with --watch, the read of each rediff)\n");
+    printf("    --huge-pages <mode>: Back large buffers with huge pages: off (default), thp (transparent) or pool (reserved huge pages)\n");
+    printf("    --top <n>: Only show the n asset changes with the largest byte impact\n");
+    printf("    --reloc <file>: Ignore offset changes in the asset fields listed in a relocation table\n");
+    printf("    --plugin <file>: Load asset decoders from a plugin for field-level diffs with -d (can be repeated)\n");
+    printf("    --text: Show line diffs of assets that look like text with -d\n");
+    printf("    --text-types <types>: Comma separated asset types to always show line diffs of with -d (e.g. TEXT,CNTR)\n");
+    printf("    --summary: Only show added/deleted/modified counts and byte changes per asset type\n");
+    printf("    --export <prefix>: Write the asset, layer and diff tables to <prefix>assets, <prefix>layers, <prefix>layer_assets and <prefix>diff\n");
+    printf("    --export-format <format>: Table format: csv (default) or columnar (binary, .hdc)\n");
+    printf("    --tui: Browse the diff interactively, asset details are computed when expanded (ignores -d and --top)\n");
+    printf("    --verify: Recompute ADBG checksums, report stale ones and don't trust them for -c\n");
+    printf("    --order: Diff the order of assets in ATOC and in each layer\n");
+    printf("    --validate: Check HIP files for corruption instead of diffing\n");
+    printf("    --watch: Rediff whenever the modified HIP file is rewritten\n");
+    printf("    --level: Diff each side's HIP and HOP as one level and report assets moved between them (HOP files are found next to the HIP files unless given)\n");
+    printf("    --overlay: Diff the assets each side's archive stack resolves to, later archives overriding earlier ones (e.g. boot.HIP,shared.HIP,level.HIP)\n");
+    printf("               Archives are matched by file name, or by position in the stack when the stacks share no names and are the same length\n");
+    printf("    --store <dir>: Diff versions kept in a content addressed store (each distinct asset is stored once) instead of files\n");
+    printf("    --ingest: Add a file to the store as a named version\n");
+    printf("    --restore: Write a stored version back out as a file, byte for byte\n");
+    printf("    --git-diff: Run as git's external diff driver (unified format unless -f is given, ignores --watch and --tui)\n");
+    printf("    --cache <dir>: With --git-diff, keep each blob's parsed tables and asset data hashes in <dir> so it's only parsed once\n");
+    printf("                   (not used with --top, --verify, --reloc, --tui or -d with --text, --text-types or plugins, which need the asset data)\n");
+    printf("    --textconv: Print one HIP file as text, one line per chunk, asset and layer asset, for git's textconv\n");
+    printf("\n");
+    printf("A HIP file given as - is read from standard input. Input from pipes (e.g. <(zcat a.hip.gz)) is parsed as it arrives, and the header sections are printed as soon as both files' tables are read\n");
+    printf("\n");
+    printf("git setup (.gitattributes: *.hip diff=hip, *.hop diff=hip):\n");
+    printf("    git config diff.hip.command \"hipdiff --git-diff --cache .git/hipdiff-cache\"\n");
+    printf("    or: git config diff.hip.textconv \"hipdiff --textconv\" and git config diff.hip.cachetextconv true\n");
 }
 
-int main(int argc, char** argv)
+// Parse a comma separated list of four character asset types
+static bool parseTypeList(const char* str, std::unordered_set<uint32_t>& types)
 {
-#ifdef _WIN32
-    // Enable text coloring in console
-    // https://learn.microsoft.com/en-us/windows/console/console-virtual-terminal-sequences
+    while (true) {
+        uint32_t type = 0;
+        int len = 0;
+        for (; str[len] && str[len] != ','; len++) {
+            type = (type << 8) | (uint8_t)str[len];
+        }
+        if (len != 4) return false;
+        types.insert(type);
 
-    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (hOut == INVALID_HANDLE_VALUE)
-    {
-        return GetLastError();
+        if (!str[len]) return true;
+        str += len + 1;
     }
+}
 
-    DWORD dwMode = 0;
-    if (!GetConsoleMode(hOut, &dwMode))
-    {
-        return GetLastError();
+// Hip::open reads standard input for this
+static bool isStdinPath(const char* path)
+{
+    return !strcmp(path, "-");
+}
+
+struct TablesReadHook
+{
+    HipTablesCallback callback;
+    void* user;
+};
+
+static void onHipTablesRead(Hip& hip, void* user)
+{
+    // Before anything can see the string
+    hackPCRTString(hip.pcrt.string);
+
+    const TablesReadHook* hook = (const TablesReadHook*)user;
+    if (hook->callback) hook->callback(hip, hook->user);
+}
+
+static bool readHip(Hip& hip, const char* path, HipTablesCallback tablesRead = nullptr, void* user = nullptr)
+{
+    if (!hip.open(path)) {
+        printf("Could not open file '%s'\n", path);
+        return false;
     }
 
-    dwMode |= ENABLE_VIRTUAL_TERMINAL_PROCESSING;
-    if (!SetConsoleMode(hOut, dwMode))
-    {
-        return GetLastError();
+    //printf("Reading HIP file '%s'\n", path);
+    TablesReadHook hook = { tablesRead, user };
+    if (!hip.read(onHipTablesRead, &hook)) {
+        printf("Could not read file '%s'\n", path);
+        return false;
     }
-#endif
 
-    if (argc <= 1) {
-        printVersion();
-        printf("\n");
-        printUsage();
-        return 1;
+    // Everything is in memory now (or mapped)
+    hip.close();
+
+    return true;
+}
+
+static void buildAssetIndex(Hip& ohip, Hip& mhip, std::map<uint32_t, Index>& ahdrIndices)
+{
+    for (uint32_t i = 0; i < ohip.pcnt.assetCount; i++) {
+        ahdrIndices[ohip.ahdr[i].id].oidx = i;
+    }
+    for (uint32_t i = 0; i < mhip.pcnt.assetCount; i++) {
+        ahdrIndices[mhip.ahdr[i].id].midx = i;
     }
+}
 
-    bool showHelp = false;
-    bool showVersion = false;
-    bool assetDiffsOnly = false;
-    bool detailedAssets = false;
-    bool ignoreDataIfChksumMatch = false;
-    bool diffOffsets = false;
-    bool diffPluses = false;
-    const char* paths[2] = {};
-    int pathCount = 0;
+// Recomputed ADBG checksums and whether they differ from the stored ones, per asset index
+struct AssetChecksums
+{
+    std::vector<uint32_t> actual;
+    std::vector<char> stale;
+};
 
-    for (int i = 1; i < argc; i++) {
-        char* arg = argv[i];
-        if (arg[0] == '-') {
-            if (!Stricmp(arg, "-h")) showHelp = true;
-            else if (!Stricmp(arg, "-v")) showVersion = true;
-            else if (!Stricmp(arg, "-a")) assetDiffsOnly = true;
-            else if (!Stricmp(arg, "-d")) detailedAssets = true;
-            else if (!Stricmp(arg, "-c")) ignoreDataIfChksumMatch = true;
-            else if (!Stricmp(arg, "-o")) diffOffsets = true;
-            else if (!Stricmp(arg, "-p")) diffPluses = true;
-            else if (!Stricmp(arg, "-w")) {
-                char* width = argv[i+1];
-                columnWidth = atoi(width);
-                if (columnWidth <= 0) columnWidth = DEFAULT_COLUMN_WIDTH;
-                i++;
-            }
-            else {
-                printf("Unknown option '%s'\n", arg);
-                printf("\n");
-                printUsage();
-                return 1;
-            }
-        } else {
-            if (pathCount < 2) {
-                paths[pathCount++] = arg;
-            } else {
-                printf("Too many arguments: '%s'\n", arg);
-                printf("\n");
-                printUsage();
-                return 1;
-            }
+static AssetChecksums oassetChecksums;
+static AssetChecksums massetChecksums;
+
+static void verifyAssetChecksums(Hip& hip, AssetChecksums& checksums)
+{
+    checksums.actual.assign(hip.pcnt.assetCount, 0);
+    checksums.stale.assign(hip.pcnt.assetCount, 0);
+
+    parallelFor(hip.pcnt.assetCount, [&](size_t begin, size_t end, int /*chunk*/) {
+        for (size_t i = begin; i < end; i++) {
+            if (!hip.ahdr[i].data) continue; // Nothing to check the checksum against
+            uint32_t checksum = assetChecksum(hip.ahdr[i].data, hip.ahdr[i].size);
+            checksums.actual[i] = checksum;
+            checksums.stale[i] = (checksum != hip.adbg[i].checksum);
         }
+    });
+}
+
+static bool isChecksumStale(const AssetChecksums& checksums, int idx)
+{
+    return verifyChecksums && checksums.stale[idx];
+}
+
+static bool assetDataChanged(Hip& ohip, int oidx, Hip& mhip, int midx)
+{
+    const Hip::AHDR& oahdr = ohip.ahdr[oidx];
+    const Hip::AHDR& mahdr = mhip.ahdr[midx];
+    const Hip::ADBG& oadbg = ohip.adbg[oidx];
+    const Hip::ADBG& madbg = mhip.adbg[midx];
+
+    // Stale checksums can't be trusted to say the data is the same. The checksum also
+    // covers relocated offsets, so a mismatch still needs the normalized compare
+    if (ignoreDataIfChksumMatch && !isChecksumStale(oassetChecksums, oidx) && !isChecksumStale(massetChecksums, midx)) {
+        if (oadbg.checksum == madbg.checksum) return false;
+        if (!relocTable.hasType(oahdr.type)) return true;
     }
 
-    if (showHelp) {
-        printUsage();
-        return 0;
+    if (oahdr.size != mahdr.size) {
+        return true;
     }
 
-    if (showVersion) {
-        printVersion();
-        return 0;
+    if (compareHashes) {
+        return oassetHashes.find(oahdr.id)->second.hash != massetHashes.find(mahdr.id)->second.hash;
     }
 
-    if (pathCount == 0) {
-        printf("Original HIP file argument missing\n");
-        printf("\n");
-        printUsage();
-        return 1;
-    } else if (pathCount == 1) {
-        printf("Modified HIP file argument missing\n");
-        printf("\n");
-        printUsage();
-        return 1;
+    // Data outside of DPAK can't be compared, only whether both sides lack it
+    if (!oahdr.data || !mahdr.data) {
+        return oahdr.data != mahdr.data;
     }
 
-    const char* opath = paths[0];
-    const char* mpath = paths[1];
-    assert(opath);
-    assert(mpath);
+    return !relocTable.dataEqual(oahdr, mahdr);
+}
 
-    Hip ohip, mhip;
+// The checksum covers the raw data, so it also changes when only relocated offsets did
+static bool checksumChanged(const Hip::AHDR& oahdr, const Hip::ADBG& oadbg, const Hip::ADBG& madbg, bool dataChanged)
+{
+    if (oadbg.checksum == madbg.checksum) return false;
+    return dataChanged || !relocTable.hasType(oahdr.type);
+}
 
-    if (!ohip.open(opath)) {
-        printf("Could not open file '%s'\n", opath);
-        return 1;
+static bool assetChanged(const Hip::AHDR& oahdr, const Hip::ADBG& oadbg, const Hip::AHDR& mahdr, const Hip::ADBG& madbg, bool dataChanged)
+{
+    return oahdr.id != mahdr.id
+        || oahdr.type != mahdr.type
+        || (oahdr.offset != mahdr.offset && diffOffsets)
+        || oahdr.size != mahdr.size
+        || (oahdr.plus != mahdr.plus && diffPluses)
+        || oahdr.flags != mahdr.flags
+        || oadbg.align != madbg.align
+        || !hipStringEqual(oadbg.name, madbg.name)
+        || !hipStringEqual(oadbg.filename, madbg.filename)
+        || checksumChanged(oahdr, oadbg, madbg, dataChanged)
+        || dataChanged;
+}
+
+// Find the minimal set of IDs that moved between two orderings: of the IDs in both
+// sequences, everything outside their longest common subsequence.
+// Appends (old index, new index) pairs in old order
+static void findMovedIDs(const uint32_t* oids, uint32_t ocount, const uint32_t* mids, uint32_t mcount,
+                         std::vector<std::pair<int, int>>& moves)
+{
+    std::unordered_map<uint32_t, int> opos;
+    std::unordered_map<uint32_t, int> mpos;
+    opos.reserve(ocount);
+    mpos.reserve(mcount);
+    for (uint32_t i = 0; i < ocount; i++) opos[oids[i]] = i;
+    for (uint32_t i = 0; i < mcount; i++) mpos[mids[i]] = i;
+
+    std::vector<uint32_t> a, b;
+    std::vector<int> apos;
+    for (uint32_t i = 0; i < ocount; i++) {
+        if (mpos.find(oids[i]) != mpos.end()) {
+            a.push_back(oids[i]);
+            apos.push_back(i);
+        }
+    }
+    for (uint32_t i = 0; i < mcount; i++) {
+        if (opos.find(mids[i]) != opos.end()) {
+            b.push_back(mids[i]);
+        }
     }
 
-    if (!mhip.open(mpath)) {
-        printf("Could not open file '%s'\n", mpath);
-        return 1;
+    std::vector<std::pair<int, int>> matches;
+    myersLCS(a.data(), (int)a.size(), b.data(), (int)b.size(), matches);
+
+    size_t next = 0;
+    for (int i = 0; i < (int)a.size(); i++) {
+        if (next < matches.size() && matches[next].first == i) {
+            next++;
+            continue;
+        }
+        moves.push_back(std::make_pair(apos[i], mpos[a[i]]));
     }
+}
 
-    //printf("Reading HIP file '%s'\n", opath);
-    if (!ohip.read()) {
-        printf("Could not read file '%s'\n", opath);
-        return 1;
+// AHDR and ADBG field diffs of an asset in both files, each list starts with its header line
+static void assetDetailDiffs(const Hip::AHDR& oahdr, const Hip::ADBG& oadbg, const Hip::AHDR& mahdr, const Hip::ADBG& madbg,
+                             bool dataChanged, std::vector<Diff>& ahdrMods, std::vector<Diff>& adbgMods)
+{
+    MODIFICATION(ahdrMods, "  AHDR (%s)", oadbg.name, madbg.name);
+    if (oahdr.id != mahdr.id) {
+        assert(false && "How did we get here?");
+        MODIFICATION(ahdrMods, "    id: 0x%08X", oahdr.id, mahdr.id);
     }
+    if (oahdr.type != mahdr.type)
+        MODIFICATION(ahdrMods, "    type: 0x%08X", oahdr.type, mahdr.type);
+    if (oahdr.offset != mahdr.offset && diffOffsets)
+        MODIFICATION(ahdrMods, "    offset: %d", oahdr.offset, mahdr.offset);
+    if (oahdr.size != mahdr.size)
+        MODIFICATION(ahdrMods, "    size: %d", oahdr.size, mahdr.size);
+    if (oahdr.plus != mahdr.plus && diffPluses)
+        MODIFICATION(ahdrMods, "    plus: %d", oahdr.plus, mahdr.plus);
+    if (oahdr.flags != mahdr.flags)
+        MODIFICATION(ahdrMods, "    flags: 0x%08X", oahdr.flags, mahdr.flags);
+    if (dataChanged)
+        MODIFICATION(ahdrMods, "    data changed");
+
+    MODIFICATION(adbgMods, "    ADBG");
+    if (oadbg.align != madbg.align)
+        MODIFICATION(adbgMods, "      align: %d", oadbg.align, madbg.align);
+    if (!hipStringEqual(oadbg.name, madbg.name))
+        MODIFICATION(adbgMods, "      name: %s", oadbg.name, madbg.name);
+    if (!hipStringEqual(oadbg.filename, madbg.filename))
+        MODIFICATION(adbgMods, "      filename: %s", oadbg.filename, madbg.filename);
+    if (checksumChanged(oahdr, oadbg, madbg, dataChanged))
+        MODIFICATION(adbgMods, "      checksum: 0x%08X", oadbg.checksum, madbg.checksum);
+}
 
-    //printf("Reading HIP file '%s'\n", mpath);
-    if (!mhip.read()) {
-        printf("Could not read file '%s'\n", mpath);
-        return 1;
+// Field-level diff of an asset whose data changed, decoded after the asset loop
+struct DecodeJob
+{
+    int oidx;
+    int midx;
+    const HipDiffDecoder* decoder; // nullptr for a text line diff
+    bool checkText; // Only diff as text if both payloads look like text
+    size_t insertPos; // Position in assetModifications after the asset's diffs
+    bool decoded;
+    bool skipped;
+    std::vector<DecodedDiff> diffs;
+};
+
+// Run the decoders on the worker pool and insert their diffs below each asset
+static void runDecodeJobs(Hip& ohip, Hip& mhip, std::vector<DecodeJob>& jobs)
+{
+    if (jobs.empty()) return;
+
+    TaskGroup group;
+    for (DecodeJob& job : jobs) {
+        group.run([&ohip, &mhip, &job]() {
+            Hip::AHDR& oahdr = ohip.ahdr[job.oidx];
+            Hip::AHDR& mahdr = mhip.ahdr[job.midx];
+            if (job.decoder) {
+                job.decoded = decodeDiff(job.decoder, oahdr.data, oahdr.size, mahdr.data, mahdr.size, job.diffs);
+            } else if (job.checkText && !(isTextData(oahdr.data, oahdr.size) && isTextData(mahdr.data, mahdr.size))) {
+                job.skipped = true;
+            } else {
+                diffTextLines(oahdr.data, oahdr.size, mahdr.data, mahdr.size, job.diffs);
+                job.decoded = true;
+            }
+        });
     }
+    group.wait();
 
-    hackPCRTString(ohip.pcrt.string);
-    hackPCRTString(mhip.pcrt.string);
+    std::vector<Diff> diffs;
+    diffs.reserve(assetModifications.size());
 
-    struct Index
-    {
-        int oidx = -1;
-        int midx = -1;
-    };
+    countsEnabled = false;
+    size_t pos = 0;
+    for (DecodeJob& job : jobs) {
+        if (job.skipped) continue;
 
-    std::map<uint32_t, Index> ahdrIndices;
-    std::unordered_map<uint32_t, std::vector<Index>> lhdrIndices;
-    std::map<uint32_t, Index> ahdrLHDRIndices;
+        diffs.insert(diffs.end(), assetModifications.begin() + pos, assetModifications.begin() + job.insertPos);
+        pos = job.insertPos;
 
-    for (uint32_t i = 0; i < ohip.pcnt.assetCount; i++) {
-        ahdrIndices[ohip.ahdr[i].id].oidx = i;
+        const char* name = job.decoder ? job.decoder->name : "text";
+        MODIFICATION(diffs, "    DATA (%s)", name, name);
+        if (job.decoded) {
+            appendDecodedDiffs(job.diffs, 3, decodedStrings, diffs);
+        } else {
+            MODIFICATION(diffs, "      could not decode");
+        }
     }
-    for (uint32_t i = 0; i < mhip.pcnt.assetCount; i++) {
-        ahdrIndices[mhip.ahdr[i].id].midx = i;
+    diffs.insert(diffs.end(), assetModifications.begin() + pos, assetModifications.end());
+    countsEnabled = true;
+
+    assetModifications.swap(diffs);
+}
+
+// Header chunks (PACK and AINF), which come before the asset data
+static void diffHeaders(Hip& ohip, Hip& mhip)
+{
+    if (ohip.pver.subVersion != mhip.pver.subVersion)
+        MODIFICATION(pverDiffs, "  subVersion: 0x%X", ohip.pver.subVersion, mhip.pver.subVersion);
+    if (ohip.pver.clientVersion != mhip.pver.clientVersion)
+        MODIFICATION(pverDiffs, "  clientVersion: 0x%X", ohip.pver.clientVersion, mhip.pver.clientVersion);
+    if (ohip.pver.compatVersion != mhip.pver.compatVersion)
+        MODIFICATION(pverDiffs, "  compatVersion: 0x%X", ohip.pver.compatVersion, mhip.pver.compatVersion);
+    if (ohip.pflg.flags != mhip.pflg.flags)
+        MODIFICATION(pflgDiffs, "  flags: 0x%X", ohip.pflg.flags, mhip.pflg.flags);
+    if (ohip.pcnt.assetCount != mhip.pcnt.assetCount)
+        MODIFICATION(pcntDiffs, "  assetCount: %d", ohip.pcnt.assetCount, mhip.pcnt.assetCount);
+    if (ohip.pcnt.layerCount != mhip.pcnt.layerCount)
+        MODIFICATION(pcntDiffs, "  layerCount: %d", ohip.pcnt.layerCount, mhip.pcnt.layerCount);
+    if (ohip.pcnt.maxAssetSize != mhip.pcnt.maxAssetSize)
+        MODIFICATION(pcntDiffs, "  maxAssetSize: %d", ohip.pcnt.maxAssetSize, mhip.pcnt.maxAssetSize);
+    if (ohip.pcnt.maxLayerSize != mhip.pcnt.maxLayerSize)
+        MODIFICATION(pcntDiffs, "  maxLayerSize: %d", ohip.pcnt.maxLayerSize, mhip.pcnt.maxLayerSize);
+    if (ohip.pcnt.maxXformAssetSize != mhip.pcnt.maxXformAssetSize)
+        MODIFICATION(pcntDiffs, "  maxXformAssetSize: %d", ohip.pcnt.maxXformAssetSize, mhip.pcnt.maxXformAssetSize);
+    if (ohip.pcrt.time != mhip.pcrt.time)
+        MODIFICATION(pcrtDiffs, "  time: %d", ohip.pcrt.time, mhip.pcrt.time);
+    if (strcmp(ohip.pcrt.string, mhip.pcrt.string))
+        MODIFICATION(pcrtDiffs, "  \"%s\"", ohip.pcrt.string, mhip.pcrt.string);
+    if (ohip.pmod.time != mhip.pmod.time)
+        MODIFICATION(pmodDiffs, "  time: %d", ohip.pmod.time, mhip.pmod.time);
+
+    if (ohip.plat.exists || mhip.plat.exists) {
+        if (ohip.plat.exists != mhip.plat.exists) {
+            if (ohip.plat.exists && !mhip.plat.exists) {
+                DELETION(platDiffs, "  id: 0x%08X", ohip.plat.id);
+                for (int i = 0; i < ohip.plat.stringCount; i++) {
+                    DELETION(platDiffs, "  \"%s\"", ohip.plat.strings[i]);
+                }
+            } else {
+                ADDITION(platDiffs, "  id: 0x%08X", mhip.plat.id);
+                for (int i = 0; i < mhip.plat.stringCount; i++) {
+                    ADDITION(platDiffs, "  \"%s\"", mhip.plat.strings[i]);
+                }
+            }
+        } else {
+            if (ohip.plat.id != mhip.plat.id)
+                MODIFICATION(platDiffs, "  id: 0x%08X", ohip.plat.id, mhip.plat.id);
+
+            int platStringCount = ohip.plat.stringCount;
+            if (platStringCount < mhip.plat.stringCount) platStringCount = mhip.plat.stringCount;
+            for (int i = 0; i < platStringCount; i++) {
+                if (i >= ohip.plat.stringCount) {
+                    ADDITION(platDiffs, "  \"%s\"", mhip.plat.strings[i]);
+                } else if (i >= mhip.plat.stringCount) {
+                    DELETION(platDiffs, "  \"%s\"", ohip.plat.strings[i]);
+                } else if (strcmp(mhip.plat.strings[i], ohip.plat.strings[i])) {
+                    MODIFICATION(platDiffs, "  \"%s\"", ohip.plat.strings[i], mhip.plat.strings[i]);
+                }
+            }
+        }
     }
 
-    int numAssetsAdded = 0;
-    int numAssetsDeleted = 0;
-    int numAssetsModified = 0;
-    int numLayersAdded = 0;
-    int numLayersDeleted = 0;
-    int numLayersModified = 0;
+    if (ohip.ainf.ainf != mhip.ainf.ainf)
+        MODIFICATION(ainfDiffs, "  ainf: %d", ohip.ainf.ainf, mhip.ainf.ainf);
+}
+
+static void diffHips(Hip& ohip, Hip& mhip)
+{
+    std::map<uint32_t, Index> ahdrIndices;
+    std::unordered_map<uint32_t, std::vector<Index>> lhdrIndices;
+    std::unordered_map<uint32_t, Index> ahdrLHDRIndices;
+    std::vector<int> lhdrMatches(ohip.pcnt.layerCount, -1); // Matching new layer of each old layer
+
+    buildAssetIndex(ohip, mhip, ahdrIndices);
 
     std::unordered_set<uint32_t> addedAssets;
     std::unordered_set<uint32_t> deletedAssets;
+    std::vector<DecodeJob> decodeJobs;
 
     if (!assetDiffsOnly) {
-        std::map<uint32_t, int> mLayerCounts;
+        // Layers of a type are matched in order, within the same file in level mode
+        typedef std::pair<uint32_t, uint32_t> LayerKey;
+        std::map<LayerKey, std::vector<size_t>> oLayerPositions; // Positions in lhdrIndices[type]
+        std::map<LayerKey, size_t> mLayerCounts;
         for (uint32_t i = 0; i < ohip.pcnt.layerCount; i++) {
             uint32_t type = ohip.lhdr[i].type;
+            uint32_t source = oarchiveSources.layers.empty() ? 0 : oarchiveSources.layers[i];
             Index idx;
             idx.oidx = i;
+            oLayerPositions[LayerKey(type, source)].push_back(lhdrIndices[type].size());
             lhdrIndices[type].push_back(idx);
         }
         for (uint32_t i = 0; i < mhip.pcnt.layerCount; i++) {
             uint32_t type = mhip.lhdr[i].type;
-            if (lhdrIndices[type].size() < mLayerCounts[type] + 1) {
+            uint32_t source = marchiveSources.layers.empty() ? 0 : marchiveSources.layers[i];
+            LayerKey key(type, source);
+            const std::vector<size_t>& positions = oLayerPositions[key];
+            size_t count = mLayerCounts[key]++;
+            if (count < positions.size()) {
+                lhdrIndices[type][positions[count]].midx = i;
+            } else {
                 Index idx;
                 idx.midx = i;
                 lhdrIndices[type].push_back(idx);
-            } else {
-                lhdrIndices[type][mLayerCounts[type]].midx = i;
             }
-            mLayerCounts[type]++;
         }
+        for (auto it = lhdrIndices.begin(); it != lhdrIndices.end(); it++) {
+            for (Index& l : it->second) {
+                if (l.oidx != -1) lhdrMatches[l.oidx] = l.midx;
+            }
+        }
+        ahdrLHDRIndices.reserve(ohip.pcnt.assetCount + mhip.pcnt.assetCount);
         for (uint32_t i = 0; i < ohip.pcnt.layerCount; i++) {
             for (uint32_t j = 0; j < ohip.lhdr[i].assetCount; j++) {
                 ahdrLHDRIndices[ohip.lhdr[i].assetIDs[j]].oidx = i;
@@ -392,75 +847,59 @@ int main(int argc, char** argv)
         }
     }
 
+    // An asset in both files whose layers don't match was moved between layers
+    auto isMovedAsset = [&](uint32_t id) {
+        auto it = ahdrLHDRIndices.find(id);
+        if (it == ahdrLHDRIndices.end()) return false;
+        Index& a = it->second;
+        return a.oidx != -1 && a.midx != -1 && lhdrMatches[a.oidx] != a.midx;
+    };
+
+    // An asset that resolves from a different archive of a level or overlay
+    auto isArchiveMove = [&](int oidx, int midx) {
+        return !oarchiveSources.assets.empty() && oarchiveSources.assets[oidx] != marchiveSources.assets[midx];
+    };
+
     // Perform diff
-    if (!assetDiffsOnly) {
-        if (ohip.pver.subVersion != mhip.pver.subVersion)
-            MODIFICATION(pverDiffs, "  subVersion: 0x%X", ohip.pver.subVersion, mhip.pver.subVersion);
-        if (ohip.pver.clientVersion != mhip.pver.clientVersion)
-            MODIFICATION(pverDiffs, "  clientVersion: 0x%X", ohip.pver.clientVersion, mhip.pver.clientVersion);
-        if (ohip.pver.compatVersion != mhip.pver.compatVersion)
-            MODIFICATION(pverDiffs, "  compatVersion: 0x%X", ohip.pver.compatVersion, mhip.pver.compatVersion);
-        if (ohip.pflg.flags != mhip.pflg.flags)
-            MODIFICATION(pflgDiffs, "  flags: 0x%X", ohip.pflg.flags, mhip.pflg.flags);
-        if (ohip.pcnt.assetCount != mhip.pcnt.assetCount)
-            MODIFICATION(pcntDiffs, "  assetCount: %d", ohip.pcnt.assetCount, mhip.pcnt.assetCount);
-        if (ohip.pcnt.layerCount != mhip.pcnt.layerCount)
-            MODIFICATION(pcntDiffs, "  layerCount: %d", ohip.pcnt.layerCount, mhip.pcnt.layerCount);
-        if (ohip.pcnt.maxAssetSize != mhip.pcnt.maxAssetSize)
-            MODIFICATION(pcntDiffs, "  maxAssetSize: %d", ohip.pcnt.maxAssetSize, mhip.pcnt.maxAssetSize);
-        if (ohip.pcnt.maxLayerSize != mhip.pcnt.maxLayerSize)
-            MODIFICATION(pcntDiffs, "  maxLayerSize: %d", ohip.pcnt.maxLayerSize, mhip.pcnt.maxLayerSize);
-        if (ohip.pcnt.maxXformAssetSize != mhip.pcnt.maxXformAssetSize)
-            MODIFICATION(pcntDiffs, "  maxXformAssetSize: %d", ohip.pcnt.maxXformAssetSize, mhip.pcnt.maxXformAssetSize);
-        if (ohip.pcrt.time != mhip.pcrt.time)
-            MODIFICATION(pcrtDiffs, "  time: %d", ohip.pcrt.time, mhip.pcrt.time);
-        if (strcmp(ohip.pcrt.string, mhip.pcrt.string))
-            MODIFICATION(pcrtDiffs, "  \"%s\"", ohip.pcrt.string, mhip.pcrt.string);
-        if (ohip.pmod.time != mhip.pmod.time)
-            MODIFICATION(pmodDiffs, "  time: %d", ohip.pmod.time, mhip.pmod.time);
-
-        if (ohip.plat.exists || mhip.plat.exists) {
-            if (ohip.plat.exists != mhip.plat.exists) {
-                if (ohip.plat.exists && !mhip.plat.exists) {
-                    DELETION(platDiffs, "  id: 0x%08X", ohip.plat.id);
-                    for (int i = 0; i < ohip.plat.stringCount; i++) {
-                        DELETION(platDiffs, "  \"%s\"", ohip.plat.strings[i]);
-                    }
-                } else {
-                    ADDITION(platDiffs, "  id: 0x%08X", mhip.plat.id);
-                    for (int i = 0; i < mhip.plat.stringCount; i++) {
-                        ADDITION(platDiffs, "  \"%s\"", mhip.plat.strings[i]);
-                    }
-                }
-            } else {
-                if (ohip.plat.id != mhip.plat.id)
-                    MODIFICATION(platDiffs, "  id: 0x%08X", ohip.plat.id, mhip.plat.id);
-
-                int platStringCount = ohip.plat.stringCount;
-                if (platStringCount < mhip.plat.stringCount) platStringCount = mhip.plat.stringCount;
-                for (int i = 0; i < platStringCount; i++) {
-                    if (i >= ohip.plat.stringCount) {
-                        ADDITION(platDiffs, "  \"%s\"", mhip.plat.strings[i]);
-                    } else if (i >= mhip.plat.stringCount) {
-                        DELETION(platDiffs, "  \"%s\"", ohip.plat.strings[i]);
-                    } else if (strcmp(mhip.plat.strings[i], ohip.plat.strings[i])) {
-                        MODIFICATION(platDiffs, "  \"%s\"", ohip.plat.strings[i], mhip.plat.strings[i]);
-                    }
-                }
+    if (!assetDiffsOnly && !headersPrinted) diffHeaders(ohip, mhip);
+
+    if (verifyChecksums) {
+        countsEnabled = false;
+        for (auto it = ahdrIndices.begin(); it != ahdrIndices.end(); it++) {
+            Index& a = it->second;
+            bool ostale = (a.oidx != -1) && oassetChecksums.stale[a.oidx];
+            bool mstale = (a.midx != -1) && massetChecksums.stale[a.midx];
+            diffAssetType = (a.oidx != -1) ? ohip.ahdr[a.oidx].type : mhip.ahdr[a.midx].type;
+            if (ostale && mstale) {
+                MODIFICATION(staleChecksumDiffs, "  %s", ohip.adbg[a.oidx].name, mhip.adbg[a.midx].name);
+                MODIFICATION(staleChecksumDiffs, "    checksum: 0x%08X", ohip.adbg[a.oidx].checksum, mhip.adbg[a.midx].checksum);
+                MODIFICATION(staleChecksumDiffs, "    actual: 0x%08X", oassetChecksums.actual[a.oidx], massetChecksums.actual[a.midx]);
+            } else if (ostale) {
+                DELETION(staleChecksumDiffs, "  %s", ohip.adbg[a.oidx].name);
+                DELETION(staleChecksumDiffs, "    checksum: 0x%08X", ohip.adbg[a.oidx].checksum);
+                DELETION(staleChecksumDiffs, "    actual: 0x%08X", oassetChecksums.actual[a.oidx]);
+            } else if (mstale) {
+                ADDITION(staleChecksumDiffs, "  %s", mhip.adbg[a.midx].name);
+                ADDITION(staleChecksumDiffs, "    checksum: 0x%08X", mhip.adbg[a.midx].checksum);
+                ADDITION(staleChecksumDiffs, "    actual: 0x%08X", massetChecksums.actual[a.midx]);
             }
+            if (ostale || mstale) numStaleChecksums++;
         }
-
-        if (ohip.ainf.ainf != mhip.ainf.ainf)
-            MODIFICATION(ainfDiffs, "  ainf: %d", ohip.ainf.ainf, mhip.ainf.ainf);
+        diffAssetType = 0;
+        countsEnabled = true;
     }
 
     for (auto it = ahdrIndices.begin(); it != ahdrIndices.end(); it++) {
         Index& a = it->second;
         assert(a.oidx != -1 || a.midx != -1);
+        diffAssetType = (a.oidx != -1) ? ohip.ahdr[a.oidx].type : mhip.ahdr[a.midx].type;
         if (a.oidx == -1) {
             Hip::AHDR& mahdr = mhip.ahdr[a.midx];
             Hip::ADBG& madbg = mhip.adbg[a.midx];
-            if (detailedAssets) {
+            if (topCount) {
+                pushTopChange(Diff::Type::Addition, mahdr.id, -1, a.midx, mahdr.size);
+                additionCount++;
+            } else if (detailedAssets) {
                 countsEnabled = false;
                 ADDITION(assetAdditions, "  AHDR (%s)", madbg.name);
                 ADDITION(assetAdditions, "    id: 0x%08X", mahdr.id);
@@ -484,7 +923,10 @@ int main(int argc, char** argv)
         } else if (a.midx == -1) {
             Hip::AHDR& oahdr = ohip.ahdr[a.oidx];
             Hip::ADBG& oadbg = ohip.adbg[a.oidx];
-            if (detailedAssets) {
+            if (topCount) {
+                pushTopChange(Diff::Type::Deletion, oahdr.id, a.oidx, -1, oahdr.size);
+                deletionCount++;
+            } else if (detailedAssets) {
                 countsEnabled = false;
                 DELETION(assetDeletions, "  AHDR (%s)", oadbg.name);
                 DELETION(assetDeletions, "    id: 0x%08X", oahdr.id);
@@ -512,54 +954,43 @@ int main(int argc, char** argv)
             Hip::ADBG& madbg = mhip.adbg[a.midx];
             assert(oahdr.id == mahdr.id);
 
-            bool dataChanged = false;
-            if (ignoreDataIfChksumMatch) {
-                if (oadbg.checksum != madbg.checksum) {
-                    dataChanged = true;
-                }
-            } else {
-                if (oahdr.size == mahdr.size) {
-                    if (memcmp(oahdr.data, mahdr.data, oahdr.size)) {
-                        dataChanged = true;
-                    }
-                } else {
-                    dataChanged = true;
-                }
+            bool dataChanged = assetDataChanged(ohip, a.oidx, mhip, a.midx);
+            bool changed = assetChanged(oahdr, oadbg, mahdr, madbg, dataChanged);
+
+            // Reported once here, instead of as a layer move
+            if (isArchiveMove(a.oidx, a.midx)) {
+                countsEnabled = false;
+                MODIFICATION(archiveMoves, "  %s", oadbg.name, madbg.name);
+                MODIFICATION(archiveMoves, "    archive: %s", archiveNames[oarchiveSources.assets[a.oidx]].c_str(), archiveNames[marchiveSources.assets[a.midx]].c_str());
+                auto layer = ahdrLHDRIndices.find(oahdr.id);
+                if (layer != ahdrLHDRIndices.end() && layer->second.oidx != -1 && layer->second.midx != -1
+                 && ohip.lhdr[layer->second.oidx].type != mhip.lhdr[layer->second.midx].type)
+                    MODIFICATION(archiveMoves, "    layer type: %d", ohip.lhdr[layer->second.oidx].type, mhip.lhdr[layer->second.midx].type);
+                modificationCount++;
+                countsEnabled = true;
+                numArchiveMoves++;
             }
 
-            if (detailedAssets) {
+            if (topCount) {
+                if (changed) {
+                    // Size delta plus the number of changed bytes in the common range (unless
+                    // data is only compared by checksum)
+                    uint32_t minSize = (oahdr.size < mahdr.size) ? oahdr.size : mahdr.size;
+                    uint64_t impact = (oahdr.size < mahdr.size) ? (mahdr.size - oahdr.size) : (oahdr.size - mahdr.size);
+                    if (dataChanged && !ignoreDataIfChksumMatch && oahdr.data && mahdr.data) {
+                        impact += countChangedBytes(oahdr.data, mahdr.data, minSize);
+                    }
+                    pushTopChange(Diff::Type::Modification, oahdr.id, a.oidx, a.midx, impact);
+                    modificationCount++;
+                    numAssetsModified++;
+                }
+            } else if (detailedAssets) {
                 std::vector<Diff> ahdrMods;
                 std::vector<Diff> adbgMods;
 
                 countsEnabled = false;
 
-                MODIFICATION(ahdrMods, "  AHDR (%s)", oadbg.name, madbg.name);
-                if (oahdr.id != mahdr.id) {
-                    assert(false && "How did we get here?");
-                    MODIFICATION(ahdrMods, "    id: 0x%08X", oahdr.id, mahdr.id);
-                }
-                if (oahdr.type != mahdr.type)
-                    MODIFICATION(ahdrMods, "    type: 0x%08X", oahdr.type, mahdr.type);
-                if (oahdr.offset != mahdr.offset && diffOffsets)
-                    MODIFICATION(ahdrMods, "    offset: %d", oahdr.offset, mahdr.offset);
-                if (oahdr.size != mahdr.size)
-                    MODIFICATION(ahdrMods, "    size: %d", oahdr.size, mahdr.size);
-                if (oahdr.plus != mahdr.plus && diffPluses)
-                    MODIFICATION(ahdrMods, "    plus: %d", oahdr.plus, mahdr.plus);
-                if (oahdr.flags != mahdr.flags)
-                    MODIFICATION(ahdrMods, "    flags: 0x%08X", oahdr.flags, mahdr.flags);
-                if (dataChanged)
-                    MODIFICATION(ahdrMods, "    data changed");
-
-                MODIFICATION(adbgMods, "    ADBG");
-                if (oadbg.align != madbg.align)
-                    MODIFICATION(adbgMods, "      align: %d", oadbg.align, madbg.align);
-                if (strcmp(oadbg.name, madbg.name))
-                    MODIFICATION(adbgMods, "      name: %s", oadbg.name, madbg.name);
-                if (strcmp(oadbg.filename, madbg.filename))
-                    MODIFICATION(adbgMods, "      filename: %s", oadbg.filename, madbg.filename);
-                if (oadbg.checksum != madbg.checksum)
-                    MODIFICATION(adbgMods, "      checksum: 0x%08X", oadbg.checksum, madbg.checksum);
+                assetDetailDiffs(oahdr, oadbg, mahdr, madbg, dataChanged, ahdrMods, adbgMods);
 
                 if (ahdrMods.size() > 1 || adbgMods.size() > 1) {
                     assetModifications.insert(assetModifications.end(), ahdrMods.begin(), ahdrMods.end());
@@ -569,26 +1000,110 @@ int main(int argc, char** argv)
                     numAssetsModified++;
                 }
 
+                // Decoders only run on assets already known to differ, text detection
+                // is left to the job so the scan runs on the worker pool too
+                const HipDiffDecoder* decoder = decoders.find(oahdr.type);
+                bool textType = textTypes.find(oahdr.type) != textTypes.end();
+                if (dataChanged && oahdr.data && mahdr.data && oahdr.type == mahdr.type && (decoder || textType || detectText)) {
+                    DecodeJob job;
+                    job.oidx = a.oidx;
+                    job.midx = a.midx;
+                    job.decoder = decoder;
+                    job.checkText = !decoder && !textType;
+                    job.insertPos = assetModifications.size();
+                    job.decoded = false;
+                    job.skipped = false;
+                    decodeJobs.push_back(std::move(job));
+                }
+
                 countsEnabled = true;
             } else {
-                if (oahdr.id != mahdr.id
-                 || oahdr.type != mahdr.type
-                 || (oahdr.offset != mahdr.offset && diffOffsets)
-                 || oahdr.size != mahdr.size
-                 || (oahdr.plus != mahdr.plus && diffPluses)
-                 || oahdr.flags != mahdr.flags
-                 || oadbg.align != madbg.align
-                 || strcmp(oadbg.name, madbg.name)
-                 || strcmp(oadbg.filename, madbg.filename)
-                 || oadbg.checksum != madbg.checksum
-                 || dataChanged) {
+                if (changed) {
                     MODIFICATION(assetModifications, "  %s", oadbg.name, madbg.name);
+                    modifiedAssets.push_back(a);
                     numAssetsModified++;
                 }
             }
         }
     }
 
+    diffAssetType = 0;
+
+    runDecodeJobs(ohip, mhip, decodeJobs);
+
+    if (topCount) {
+        std::sort(topChanges.begin(), topChanges.end(), isLargerChange);
+
+        countsEnabled = false;
+        for (const TopChange& change : topChanges) {
+            diffAssetType = (change.oidx != -1) ? ohip.ahdr[change.oidx].type : mhip.ahdr[change.midx].type;
+            switch (change.type) {
+            case Diff::Type::Addition:
+                ADDITION(assetTopChanges, "  %s", mhip.adbg[change.midx].name);
+                ADDITION(assetTopChanges, "    size: %d", mhip.ahdr[change.midx].size);
+                break;
+            case Diff::Type::Deletion:
+                DELETION(assetTopChanges, "  %s", ohip.adbg[change.oidx].name);
+                DELETION(assetTopChanges, "    size: %d", ohip.ahdr[change.oidx].size);
+                break;
+            case Diff::Type::Modification:
+                MODIFICATION(assetTopChanges, "  %s", ohip.adbg[change.oidx].name, mhip.adbg[change.midx].name);
+                MODIFICATION(assetTopChanges, "    size: %d", ohip.ahdr[change.oidx].size, mhip.ahdr[change.midx].size);
+                MODIFICATION(assetTopChanges, "    impact: %u bytes", (uint32_t)change.impact, (uint32_t)change.impact);
+                break;
+            }
+        }
+        diffAssetType = 0;
+        countsEnabled = true;
+    }
+
+    if (diffOrder) {
+        std::vector<uint32_t> oids(ohip.pcnt.assetCount);
+        std::vector<uint32_t> mids(mhip.pcnt.assetCount);
+        for (uint32_t i = 0; i < ohip.pcnt.assetCount; i++) oids[i] = ohip.ahdr[i].id;
+        for (uint32_t i = 0; i < mhip.pcnt.assetCount; i++) mids[i] = mhip.ahdr[i].id;
+
+        std::vector<std::pair<int, int>> moves;
+        findMovedIDs(oids.data(), (uint32_t)oids.size(), mids.data(), (uint32_t)mids.size(), moves);
+
+        countsEnabled = false;
+        for (const std::pair<int, int>& move : moves) {
+            diffAssetType = ohip.ahdr[move.first].type;
+            MODIFICATION(assetOrderDiffs, "  %s", ohip.adbg[move.first].name, mhip.adbg[move.second].name);
+            MODIFICATION(assetOrderDiffs, "    index: %d", move.first, move.second);
+            modificationCount++;
+        }
+        diffAssetType = 0;
+        countsEnabled = true;
+        numAssetsReordered = (int)moves.size();
+
+        if (!assetDiffsOnly) {
+            for (auto it = lhdrIndices.begin(); it != lhdrIndices.end(); it++) {
+                for (Index& l : it->second) {
+                    if (l.oidx == -1 || l.midx == -1) continue;
+
+                    Hip::LHDR& olhdr = ohip.lhdr[l.oidx];
+                    Hip::LHDR& mlhdr = mhip.lhdr[l.midx];
+
+                    moves.clear();
+                    findMovedIDs(olhdr.assetIDs, olhdr.assetCount, mlhdr.assetIDs, mlhdr.assetCount, moves);
+                    if (moves.empty()) continue;
+
+                    countsEnabled = false;
+                    MODIFICATION(layerOrderDiffs, "  LHDR (%d)", olhdr.type, mlhdr.type);
+                    for (const std::pair<int, int>& move : moves) {
+                        uint32_t id = olhdr.assetIDs[move.first];
+                        MODIFICATION(layerOrderDiffs, "    %s", ohip.adbg[ahdrIndices[id].oidx].name, mhip.adbg[ahdrIndices[id].midx].name);
+                        MODIFICATION(layerOrderDiffs, "      index: %d", move.first, move.second);
+                        modificationCount++;
+                    }
+                    countsEnabled = true;
+                    numLayersReordered++;
+                }
+            }
+        }
+    }
+
     if (!assetDiffsOnly) {
         for (auto it = lhdrIndices.begin(); it != lhdrIndices.end(); it++) {
             for (Index& l : it->second) {
@@ -601,7 +1116,7 @@ int main(int argc, char** argv)
                     ADDITION(layerAdditions, "    type: %d", mlhdr.type);
                     for (uint32_t i = 0; i < mlhdr.assetCount; i++) {
                         uint32_t id = mlhdr.assetIDs[i];
-                        if (addedAssets.find(id) == addedAssets.end()) {
+                        if (addedAssets.find(id) == addedAssets.end() && !isMovedAsset(id)) {
                             ADDITION(layerAdditions, "    %s", mhip.adbg[ahdrIndices[id].midx].name);
                         }
                     }
@@ -619,7 +1134,7 @@ int main(int argc, char** argv)
                     //DELETION(layerDeletions, "    assetCount: %d", olhdr.assetCount);
                     for (uint32_t i = 0; i < olhdr.assetCount; i++) {
                         uint32_t id = olhdr.assetIDs[i];
-                        if (deletedAssets.find(id) == deletedAssets.end()) {
+                        if (deletedAssets.find(id) == deletedAssets.end() && !isMovedAsset(id)) {
                             DELETION(layerDeletions, "    %s", ohip.adbg[ahdrIndices[id].oidx].name);
                         }
                     }
@@ -646,22 +1161,27 @@ int main(int argc, char** argv)
                         MODIFICATION(lhdrMods, "    type: %d", olhdr.type, mlhdr.type);
                     }
 
-                    for (auto it = ahdrLHDRIndices.begin(); it != ahdrLHDRIndices.end(); it++) {
-                        uint32_t id = it->first;
-                        Index& a = it->second;
-                        assert(a.oidx != -1 || a.midx != -1);
-                        if (a.oidx == l.oidx || a.midx == l.midx) {
-                            if (a.oidx != l.oidx) {
-                                if (addedAssets.find(id) == addedAssets.end()) {
-                                    ADDITION(lhdrMods, "    \"%s\"", mhip.adbg[ahdrIndices[id].midx].name);
-                                    additionCount++;
-                                }
-                            } else if (a.midx != l.midx) {
-                                if (deletedAssets.find(id) == deletedAssets.end()) {
-                                    DELETION(lhdrMods, "    \"%s\"", ohip.adbg[ahdrIndices[id].oidx].name);
-                                    deletionCount++;
-                                }
-                            }
+                    // Only this layer's own assets can be added to or removed from it
+                    std::vector<uint32_t> changedIDs;
+                    for (uint32_t i = 0; i < mlhdr.assetCount; i++) {
+                        uint32_t id = mlhdr.assetIDs[i];
+                        if (ahdrLHDRIndices[id].oidx != l.oidx && addedAssets.find(id) == addedAssets.end() && !isMovedAsset(id))
+                            changedIDs.push_back(id);
+                    }
+                    for (uint32_t i = 0; i < olhdr.assetCount; i++) {
+                        uint32_t id = olhdr.assetIDs[i];
+                        if (ahdrLHDRIndices[id].midx != l.midx && deletedAssets.find(id) == deletedAssets.end() && !isMovedAsset(id))
+                            changedIDs.push_back(id);
+                    }
+                    std::sort(changedIDs.begin(), changedIDs.end());
+
+                    for (uint32_t id : changedIDs) {
+                        if (ahdrLHDRIndices[id].oidx != l.oidx) {
+                            ADDITION(lhdrMods, "    \"%s\"", mhip.adbg[ahdrIndices[id].midx].name);
+                            additionCount++;
+                        } else {
+                            DELETION(lhdrMods, "    \"%s\"", ohip.adbg[ahdrIndices[id].oidx].name);
+                            deletionCount++;
                         }
                     }
 
@@ -681,38 +1201,1385 @@ int main(int argc, char** argv)
                 }
             }
         }
-    }
-
-    const char* oname = opath /*filenameFromPath(opath)*/;
-    const char* mname = mpath /*filenameFromPath(mpath)*/;
 
-    int onameWidth = (int)(strlen(oname) + 1);
-    int mnameWidth = (int)(strlen(oname) + 1);
-    if (onameWidth > columnWidth) columnWidth = onameWidth;
-    if (mnameWidth > columnWidth) columnWidth = mnameWidth;
-
-    printDiffHeader(oname, mname);
-    if (!assetDiffsOnly) {
-        printDiffs(pverDiffs, "PVER");
-        printDiffs(pflgDiffs, "PFLG");
-        printDiffs(pcntDiffs, "PCNT");
-        printDiffs(pcrtDiffs, "PCRT");
-        printDiffs(pmodDiffs, "PMOD");
-        printDiffs(platDiffs, "PLAT");
-        printDiffs(ainfDiffs, "AINF");
-    }
-    printDiffs(assetAdditions, "Added assets", numAssetsAdded);
-    printDiffs(assetDeletions, "Deleted assets", numAssetsDeleted);
-    printDiffs(assetModifications, "Modified assets", numAssetsModified);
+        countsEnabled = false;
+        for (uint32_t i = 0; i < ohip.pcnt.layerCount; i++) {
+            Hip::LHDR& olhdr = ohip.lhdr[i];
+            for (uint32_t j = 0; j < olhdr.assetCount; j++) {
+                uint32_t id = olhdr.assetIDs[j];
+                if (!isMovedAsset(id)) continue;
+                if (isArchiveMove(ahdrIndices[id].oidx, ahdrIndices[id].midx)) continue;
+
+                Index& a = ahdrLHDRIndices[id];
+                Hip::LHDR& mlhdr = mhip.lhdr[a.midx];
+                MODIFICATION(layerMoves, "  %s", ohip.adbg[ahdrIndices[id].oidx].name, mhip.adbg[ahdrIndices[id].midx].name);
+                MODIFICATION(layerMoves, "    layer: %d", a.oidx, a.midx);
+                MODIFICATION(layerMoves, "    type: %d", olhdr.type, mlhdr.type);
+                modificationCount++;
+                numAssetsMoved++;
+            }
+        }
+        countsEnabled = true;
+    }
+}
+
+static void printDiffHeaders(DiffSink& sink, const char* oname, const char* mname)
+{
+    sink.begin(oname, mname);
+    if (!assetDiffsOnly) {
+        printDiffs(sink, pverDiffs, "PVER");
+        printDiffs(sink, pflgDiffs, "PFLG");
+        printDiffs(sink, pcntDiffs, "PCNT");
+        printDiffs(sink, pcrtDiffs, "PCRT");
+        printDiffs(sink, pmodDiffs, "PMOD");
+        printDiffs(sink, platDiffs, "PLAT");
+        printDiffs(sink, ainfDiffs, "AINF");
+    }
+}
+
+static void printDiffResults(DiffSink& sink, const char* oname, const char* mname)
+{
+    if (!headersPrinted) printDiffHeaders(sink, oname, mname);
+    printDiffs(sink, staleChecksumDiffs, "Stale checksums", numStaleChecksums);
+    printDiffs(sink, assetAdditions, "Added assets", numAssetsAdded);
+    printDiffs(sink, assetDeletions, "Deleted assets", numAssetsDeleted);
+    printDiffs(sink, assetModifications, "Modified assets", numAssetsModified);
+    printDiffs(sink, assetTopChanges, "Largest asset changes", (int)topChanges.size());
+    printDiffs(sink, assetOrderDiffs, "Reordered assets", numAssetsReordered);
+    printDiffs(sink, archiveMoves, archiveMovesTitle, numArchiveMoves);
+    if (!assetDiffsOnly) {
+        printDiffs(sink, layerAdditions, "Added layers", numLayersAdded);
+        printDiffs(sink, layerDeletions, "Deleted layers", numLayersDeleted);
+        printDiffs(sink, layerModifications, "Modified layers", numLayersModified);
+        printDiffs(sink, layerMoves, "Moved assets", numAssetsMoved);
+        printDiffs(sink, layerOrderDiffs, "Reordered layers", numLayersReordered);
+    }
+    sink.end(additionCount, deletionCount, modificationCount);
+}
+
+// Changed byte ranges closer together than this are shown as one
+#define TUI_RANGE_MERGE_GAP 16
+#define TUI_MAX_RANGES 1000
+#define TUI_MAX_HEX_ROWS 4096
+
+struct ByteRange
+{
+    uint32_t start;
+    uint32_t end;
+};
+
+static void findChangedRanges(const Hip::AHDR& oahdr, const Hip::AHDR& mahdr, std::vector<ByteRange>& ranges)
+{
+    uint32_t minSize = (oahdr.size < mahdr.size) ? oahdr.size : mahdr.size;
+    uint32_t maxSize = (oahdr.size < mahdr.size) ? mahdr.size : oahdr.size;
+
+    uint32_t i = 0;
+    while (i < minSize && ranges.size() < TUI_MAX_RANGES) {
+        if (oahdr.data[i] == mahdr.data[i]) {
+            i++;
+            continue;
+        }
+
+        ByteRange range;
+        range.start = i;
+        uint32_t lastChanged = i;
+        while (i < minSize && i - lastChanged < TUI_RANGE_MERGE_GAP) {
+            if (oahdr.data[i] != mahdr.data[i]) lastChanged = i;
+            i++;
+        }
+        range.end = lastChanged + 1;
+        ranges.push_back(range);
+    }
+
+    if (minSize < maxSize) {
+        ByteRange range;
+        range.start = minSize;
+        range.end = maxSize;
+        ranges.push_back(range);
+    }
+}
+
+// One 16 byte hex dump row, blank past the end of the data. Returns false if the whole row is past it
+static bool formatHexRow(const Hip::AHDR& ahdr, uint32_t row, char* buf, size_t bufsize)
+{
+    if (row >= ahdr.size) return false;
+
+    int n = snprintf(buf, bufsize, "%08X ", row);
+    for (uint32_t i = row; i < row + 16 && n + 4 < (int)bufsize; i++) {
+        if (i < ahdr.size) n += snprintf(buf + n, bufsize - n, " %02X", (uint8_t)ahdr.data[i]);
+        else n += snprintf(buf + n, bufsize - n, "   ");
+    }
+    return true;
+}
+
+static void addTuiHexRows(const Hip::AHDR& oahdr, const Hip::AHDR& mahdr, ByteRange range, std::vector<TuiItem>& items)
+{
+    char left[80];
+    char right[80];
+
+    int rowCount = 0;
+    for (uint32_t row = range.start & ~15u; row < range.end && rowCount < TUI_MAX_HEX_ROWS; row += 16, rowCount++) {
+        bool hasLeft = formatHexRow(oahdr, row, left, sizeof(left));
+        bool hasRight = formatHexRow(mahdr, row, right, sizeof(right));
+
+        Diff::Type type = Diff::Type::Modification;
+        if (!hasLeft) type = Diff::Type::Addition;
+        else if (!hasRight) type = Diff::Type::Deletion;
+        items.push_back(tuiItem(type, hasLeft ? left : nullptr, hasRight ? right : nullptr));
+    }
+}
+
+// Nest diff lines by their indentation: lines indented deeper than the one before
+// become its children. Returns the position of the first line above depth
+static size_t addTuiDiffs(const std::vector<Diff>& diffs, size_t pos, int depth, std::vector<TuiItem>& items)
+{
+    while (pos < diffs.size()) {
+        int lineDepth = diffDepth(diffs[pos]);
+        if (lineDepth < depth) break;
+
+        items.push_back(tuiItem(diffs[pos]));
+        pos++;
+
+        if (pos < diffs.size() && diffDepth(diffs[pos]) > lineDepth) {
+            TuiItem& item = items.back();
+            pos = addTuiDiffs(diffs, pos, lineDepth + 1, item.children);
+            item.expand = [](std::vector<TuiItem>&) {};
+            item.populated = true;
+        }
+    }
+    return pos;
+}
+
+static void addTuiSection(std::vector<TuiItem>& items, const std::vector<Diff>& diffs, const char* title, int count = -1)
+{
+    if (diffs.empty()) return;
+
+    const std::vector<Diff>* sectionDiffs = &diffs;
+    TuiItem section = tuiHeader(title, count);
+    section.expand = [sectionDiffs](std::vector<TuiItem>& children) {
+        addTuiDiffs(*sectionDiffs, 0, 0, children);
+    };
+    items.push_back(section);
+}
+
+// Details of a modified asset, computed when its row is first expanded
+static void addTuiAssetDetails(Hip& ohip, Hip& mhip, Index a, std::vector<TuiItem>& items)
+{
+    Hip::AHDR& oahdr = ohip.ahdr[a.oidx];
+    Hip::AHDR& mahdr = mhip.ahdr[a.midx];
+    Hip::ADBG& oadbg = ohip.adbg[a.oidx];
+    Hip::ADBG& madbg = mhip.adbg[a.midx];
+
+    bool dataChanged = assetDataChanged(ohip, a.oidx, mhip, a.midx);
+
+    std::vector<Diff> ahdrMods;
+    std::vector<Diff> adbgMods;
+
+    countsEnabled = false;
+    assetDetailDiffs(oahdr, oadbg, mahdr, madbg, dataChanged, ahdrMods, adbgMods);
+    countsEnabled = true;
+
+    // The asset row already names the asset, so skip the AHDR line
+    std::vector<Diff> details(ahdrMods.begin() + 1, ahdrMods.end());
+    if (adbgMods.size() > 1) details.insert(details.end(), adbgMods.begin(), adbgMods.end());
+    addTuiDiffs(details, 0, 0, items);
+
+    if (!dataChanged || !oahdr.data || !mahdr.data) return;
+
+    Hip::AHDR* o = &oahdr;
+    Hip::AHDR* m = &mahdr;
+
+    TuiItem ranges = tuiItem(Diff::Type::Modification, "byte ranges", "byte ranges");
+    ranges.expand = [o, m](std::vector<TuiItem>& children) {
+        std::vector<ByteRange> changed;
+        findChangedRanges(*o, *m, changed);
+
+        for (const ByteRange& range : changed) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "0x%X-0x%X (%u bytes)", range.start, range.end, range.end - range.start);
+
+            TuiItem item = tuiItem(Diff::Type::Modification, buf, buf);
+            item.expand = [o, m, range](std::vector<TuiItem>& rows) { addTuiHexRows(*o, *m, range, rows); };
+            children.push_back(item);
+        }
+    };
+    items.push_back(ranges);
+
+    const HipDiffDecoder* decoder = (oahdr.type == mahdr.type) ? decoders.find(oahdr.type) : nullptr;
+    bool text = !decoder && oahdr.type == mahdr.type
+             && (textTypes.find(oahdr.type) != textTypes.end()
+              || (detectText && isTextData(oahdr.data, oahdr.size) && isTextData(mahdr.data, mahdr.size)));
+    if (!decoder && !text) return;
+
+    char title[64];
+    snprintf(title, sizeof(title), "DATA (%s)", decoder ? decoder->name : "text");
+
+    TuiItem data = tuiItem(Diff::Type::Modification, title, title);
+    data.expand = [o, m, decoder](std::vector<TuiItem>& children) {
+        std::vector<DecodedDiff> decoded;
+        if (decoder) {
+            if (!decodeDiff(decoder, o->data, o->size, m->data, m->size, decoded)) {
+                children.push_back(tuiItem(Diff::Type::Modification, "could not decode", "could not decode"));
+                return;
+            }
+        } else {
+            diffTextLines(o->data, o->size, m->data, m->size, decoded);
+        }
+
+        std::vector<Diff> diffs;
+        appendDecodedDiffs(decoded, 0, decodedStrings, diffs);
+        addTuiDiffs(diffs, 0, 0, children);
+    };
+    items.push_back(data);
+}
+
+static void buildTuiItems(Hip& ohip, Hip& mhip, std::vector<TuiItem>& items)
+{
     if (!assetDiffsOnly) {
-        printDiffs(layerAdditions, "Added layers", numLayersAdded);
-        printDiffs(layerDeletions, "Deleted layers", numLayersDeleted);
-        printDiffs(layerModifications, "Modified layers", numLayersModified);
+        addTuiSection(items, pverDiffs, "PVER");
+        addTuiSection(items, pflgDiffs, "PFLG");
+        addTuiSection(items, pcntDiffs, "PCNT");
+        addTuiSection(items, pcrtDiffs, "PCRT");
+        addTuiSection(items, pmodDiffs, "PMOD");
+        addTuiSection(items, platDiffs, "PLAT");
+        addTuiSection(items, ainfDiffs, "AINF");
+    }
+    addTuiSection(items, staleChecksumDiffs, "Stale checksums", numStaleChecksums);
+    addTuiSection(items, assetAdditions, "Added assets", numAssetsAdded);
+    addTuiSection(items, assetDeletions, "Deleted assets", numAssetsDeleted);
+
+    if (!modifiedAssets.empty()) {
+        TuiItem section = tuiHeader("Modified assets", numAssetsModified);
+        section.expand = [&ohip, &mhip](std::vector<TuiItem>& children) {
+            children.reserve(modifiedAssets.size());
+            for (size_t i = 0; i < modifiedAssets.size(); i++) {
+                Index a = modifiedAssets[i];
+                TuiItem item = tuiItem(assetModifications[i]);
+                item.expand = [&ohip, &mhip, a](std::vector<TuiItem>& details) { addTuiAssetDetails(ohip, mhip, a, details); };
+                children.push_back(item);
+            }
+        };
+        items.push_back(section);
+    }
+
+    addTuiSection(items, assetOrderDiffs, "Reordered assets", numAssetsReordered);
+    addTuiSection(items, archiveMoves, archiveMovesTitle, numArchiveMoves);
+    if (!assetDiffsOnly) {
+        addTuiSection(items, layerAdditions, "Added layers", numLayersAdded);
+        addTuiSection(items, layerDeletions, "Deleted layers", numLayersDeleted);
+        addTuiSection(items, layerModifications, "Modified layers", numLayersModified);
+        addTuiSection(items, layerMoves, "Moved assets", numAssetsMoved);
+        addTuiSection(items, layerOrderDiffs, "Reordered layers", numLayersReordered);
+    }
+}
+
+struct TypeSummary
+{
+    int added = 0;
+    int deleted = 0;
+    int modified = 0;
+    int64_t totalBytes = 0; // Sum of the absolute size change of each asset
+    int64_t netBytes = 0;
+};
+
+static void mergeTypeSummaries(std::map<uint32_t, TypeSummary>& dst, const std::map<uint32_t, TypeSummary>& src)
+{
+    for (auto it = src.begin(); it != src.end(); it++) {
+        TypeSummary& d = dst[it->first];
+        d.added += it->second.added;
+        d.deleted += it->second.deleted;
+        d.modified += it->second.modified;
+        d.totalBytes += it->second.totalBytes;
+        d.netBytes += it->second.netBytes;
+    }
+}
+
+// Aggregate added/deleted/modified counts and byte changes per asset type,
+// over chunks of the asset index in parallel
+static void summarizeHips(Hip& ohip, Hip& mhip, std::map<uint32_t, TypeSummary>& summaries)
+{
+    std::map<uint32_t, Index> ahdrIndices;
+    buildAssetIndex(ohip, mhip, ahdrIndices);
+
+    std::vector<Index> indices;
+    indices.reserve(ahdrIndices.size());
+    for (auto it = ahdrIndices.begin(); it != ahdrIndices.end(); it++) {
+        indices.push_back(it->second);
+    }
+
+    std::vector<std::map<uint32_t, TypeSummary>> chunkSummaries(parallelChunkCount(indices.size()));
+
+    parallelFor(indices.size(), [&](size_t begin, size_t end, int chunk) {
+        std::map<uint32_t, TypeSummary>& chunkSummary = chunkSummaries[chunk];
+        for (size_t i = begin; i < end; i++) {
+            const Index& a = indices[i];
+            if (a.oidx == -1) {
+                const Hip::AHDR& mahdr = mhip.ahdr[a.midx];
+                TypeSummary& s = chunkSummary[mahdr.type];
+                s.added++;
+                s.totalBytes += mahdr.size;
+                s.netBytes += mahdr.size;
+            } else if (a.midx == -1) {
+                const Hip::AHDR& oahdr = ohip.ahdr[a.oidx];
+                TypeSummary& s = chunkSummary[oahdr.type];
+                s.deleted++;
+                s.totalBytes += oahdr.size;
+                s.netBytes -= oahdr.size;
+            } else {
+                const Hip::AHDR& oahdr = ohip.ahdr[a.oidx];
+                const Hip::AHDR& mahdr = mhip.ahdr[a.midx];
+                const Hip::ADBG& oadbg = ohip.adbg[a.oidx];
+                const Hip::ADBG& madbg = mhip.adbg[a.midx];
+                bool dataChanged = assetDataChanged(ohip, a.oidx, mhip, a.midx);
+                if (assetChanged(oahdr, oadbg, mahdr, madbg, dataChanged)) {
+                    int64_t delta = (int64_t)mahdr.size - (int64_t)oahdr.size;
+                    TypeSummary& s = chunkSummary[mahdr.type];
+                    s.modified++;
+                    s.totalBytes += (delta < 0) ? -delta : delta;
+                    s.netBytes += delta;
+                }
+            }
+        }
+    });
+
+    for (const std::map<uint32_t, TypeSummary>& chunkSummary : chunkSummaries) {
+        mergeTypeSummaries(summaries, chunkSummary);
+    }
+}
+
+static void classifyAssets(Hip& ohip, Hip& mhip, AssetClassification& classification)
+{
+    std::map<uint32_t, Index> ahdrIndices;
+    buildAssetIndex(ohip, mhip, ahdrIndices);
+
+    size_t count = ahdrIndices.size();
+    classification.ids.resize(count);
+    classification.oindices.resize(count);
+    classification.mindices.resize(count);
+    classification.statuses.resize(count);
+
+    size_t row = 0;
+    for (auto it = ahdrIndices.begin(); it != ahdrIndices.end(); it++, row++) {
+        classification.ids[row] = it->first;
+        classification.oindices[row] = it->second.oidx;
+        classification.mindices[row] = it->second.midx;
+    }
+
+    parallelFor(count, [&](size_t begin, size_t end, int /*chunk*/) {
+        for (size_t i = begin; i < end; i++) {
+            int oidx = classification.oindices[i];
+            int midx = classification.mindices[i];
+            AssetStatus status = AssetStatus::Unchanged;
+            if (oidx == -1) {
+                status = AssetStatus::Added;
+            } else if (midx == -1) {
+                status = AssetStatus::Deleted;
+            } else {
+                bool dataChanged = assetDataChanged(ohip, oidx, mhip, midx);
+                if (assetChanged(ohip.ahdr[oidx], ohip.adbg[oidx], mhip.ahdr[midx], mhip.adbg[midx], dataChanged)) {
+                    status = AssetStatus::Modified;
+                }
+            }
+            classification.statuses[i] = status;
+        }
+    });
+}
+
+static const char* typeString(uint32_t type, char* buf)
+{
+    for (int i = 0; i < 4; i++) {
+        char c = (char)(type >> (24 - i * 8));
+        buf[i] = isprint((unsigned char)c) ? c : '?';
+    }
+    buf[4] = '\0';
+    return buf;
+}
+
+static void printTypeSummaries(OutputBuffer& out, const std::map<uint32_t, TypeSummary>& summaries)
+{
+    char typeBuf[5];
+
+    if (outputFormat == OutputFormat::Json) {
+        out.writeChar('[');
+        bool first = true;
+        for (auto it = summaries.begin(); it != summaries.end(); it++) {
+            const TypeSummary& s = it->second;
+            if (!first) out.writeChar(',');
+            first = false;
+            out.writef("\n{\"type\":\"%s\",\"added\":%d,\"deleted\":%d,\"modified\":%d,\"totalBytes\":%lld,\"netBytes\":%lld}",
+                       typeString(it->first, typeBuf), s.added, s.deleted, s.modified, (long long)s.totalBytes, (long long)s.netBytes);
+        }
+        out.writeString("\n]\n");
+        out.flush();
+        return;
+    }
+
+    TypeSummary total;
+    out.writef("%-6s%10s%10s%10s%14s%14s\n", "Type", "Added", "Deleted", "Modified", "Total bytes", "Net bytes");
+    for (auto it = summaries.begin(); it != summaries.end(); it++) {
+        const TypeSummary& s = it->second;
+        out.writef("%-6s%10d%10d%10d%14lld%+14lld\n",
+                   typeString(it->first, typeBuf), s.added, s.deleted, s.modified, (long long)s.totalBytes, (long long)s.netBytes);
+        total.added += s.added;
+        total.deleted += s.deleted;
+        total.modified += s.modified;
+        total.totalBytes += s.totalBytes;
+        total.netBytes += s.netBytes;
+    }
+    out.writef("%-6s%10d%10d%10d%14lld%+14lld\n",
+               "Total", total.added, total.deleted, total.modified, (long long)total.totalBytes, (long long)total.netBytes);
+    out.flush();
+}
+
+// Read throughput, on stderr so it doesn't mix with the diff output
+static void printIoStats(uint64_t bytes, double seconds)
+{
+    double megabytes = bytes / (1024.0 * 1024.0);
+    fprintf(stderr, "Read %.1f MB in %.3f s (%.1f MB/s)\n", megabytes, seconds, seconds > 0 ? megabytes / seconds : 0.0);
+}
+
+// Parse and validate every file in parallel, then print the results in argument order.
+// Returns true if all files are valid
+static bool validateFiles(const std::vector<const char*>& paths)
+{
+    struct Result
+    {
+        bool valid = false;
+        std::vector<std::string> problems;
+    };
+
+    std::vector<Result> results(paths.size());
+
+    auto startTime = std::chrono::steady_clock::now();
+    uint64_t startBytes = ioBytesRead();
+
+    TaskGroup group;
+    for (size_t i = 0; i < paths.size(); i++) {
+        group.run([&paths, &results, i]() {
+            Result& result = results[i];
+
+            Hip hip;
+            hip.setQuiet(true);
+
+            if (!hip.open(paths[i])) {
+                result.problems.push_back("Could not open file");
+                return;
+            }
+
+            if (!hip.read()) {
+                result.problems.push_back(std::string("Could not read file: ") + hip.lastError());
+                return;
+            }
+
+            hip.close();
+            result.valid = validateHip(hip, result.problems);
+        });
+    }
+    group.wait();
+
+    if (ioStats) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        printIoStats(ioBytesRead() - startBytes, seconds);
+    }
+
+    int validCount = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        const Result& result = results[i];
+        if (result.valid) {
+            printf("%s: OK\n", paths[i]);
+            validCount++;
+        } else {
+            printf("%s: INVALID\n", paths[i]);
+            for (const std::string& problem : result.problems) {
+                printf("    %s\n", problem.c_str());
+            }
+        }
     }
 
     printf("\n");
-    printf("%d addition(s), %d deletion(s), %d modification(s)\n",
-           additionCount, deletionCount, modificationCount);
+    printf("%d of %d file(s) valid\n", validCount, (int)paths.size());
 
-    return 0;
-}
\ No newline at end of file
+    return validCount == (int)paths.size();
+}
+
+// The .HOP next to a .HIP, matching the extension's case
+static bool hopPathFromHip(const char* path, std::string& hopPath)
+{
+    size_t len = strlen(path);
+    if (len < 4 || Stricmp(path + len - 4, ".hip")) return false;
+
+    hopPath = path;
+    hopPath[len - 2] = (path[len - 2] == 'I') ? 'O' : 'o';
+    return true;
+}
+
+// Split a comma separated archive stack
+static void parseArchiveStack(const char* str, std::vector<std::string>& paths)
+{
+    while (true) {
+        const char* end = strchr(str, ',');
+        if (!end) {
+            paths.push_back(str);
+            return;
+        }
+        paths.push_back(std::string(str, end - str));
+        str = end + 1;
+    }
+}
+
+// Diffs and prints the header sections once both sides have read their tables, while the
+// asset data of the other side may still be arriving (from a pipe, say)
+struct EarlyHeaders
+{
+    std::mutex mutex;
+    Hip* hips;
+    int tablesRead;
+    DiffSink* sink;
+    OutputBuffer* out;
+    const char* oname;
+    const char* mname;
+};
+
+static void onEarlyTablesRead(Hip& /*hip*/, void* user)
+{
+    EarlyHeaders* early = (EarlyHeaders*)user;
+    std::lock_guard<std::mutex> lock(early->mutex);
+    if (++early->tablesRead < 2) return;
+
+    // The other side is reading its STRM, which doesn't touch the header chunks
+    if (!assetDiffsOnly) diffHeaders(early->hips[0], early->hips[1]);
+    printDiffHeaders(*early->sink, early->oname, early->mname);
+    early->out->flush();
+    headersPrinted = true;
+}
+
+// Read the files of both sides all at once. With early, the two given files' headers are
+// printed as soon as they're read
+static bool readArchives(Hip* hips, const std::vector<std::string>& paths, EarlyHeaders* early = nullptr)
+{
+    std::vector<char> read(paths.size(), 0);
+
+    TaskGroup group;
+    for (size_t i = 0; i < paths.size(); i++) {
+        group.run([hips, &paths, &read, early, i]() {
+            read[i] = early ? readHip(hips[i], paths[i].c_str(), onEarlyTablesRead, early) : readHip(hips[i], paths[i].c_str());
+        });
+    }
+    group.wait();
+
+    return std::find(read.begin(), read.end(), 0) == read.end();
+}
+
+static uint32_t archiveNameIndex(const std::string& name)
+{
+    for (size_t i = 0; i < archiveNames.size(); i++) {
+        if (archiveNames[i] == name) return (uint32_t)i;
+    }
+    archiveNames.push_back(name);
+    return (uint32_t)archiveNames.size() - 1;
+}
+
+// Overlay a stack of archives into hip, tagging where each asset and layer came from
+static void combineArchives(Hip& hip, Hip* archives, const std::string* names, uint32_t count, ArchiveSources& sources)
+{
+    std::vector<const Hip*> stack(count);
+    std::vector<uint32_t> nameIndices(count);
+    for (uint32_t i = 0; i < count; i++) {
+        stack[i] = &archives[i];
+        nameIndices[i] = archiveNameIndex(names[i]);
+    }
+
+    hip.overlay(stack.data(), count, sources.assets, sources.layers);
+
+    for (uint32_t& source : sources.assets) source = nameIndices[source];
+    for (uint32_t& source : sources.layers) source = nameIndices[source];
+}
+
+// Options that look at asset data beyond comparing it, which cached and stored files don't have
+static bool needsAssetData()
+{
+    bool decodes = detailedAssets && (detectText || !textTypes.empty() || !decoders.empty());
+    return decodes || topCount > 0 || verifyChecksums || tuiMode || !relocTable.empty();
+}
+
+// Asset hashes of a file loaded without its data
+static void setAssetHashes(Hip& hip, const std::vector<uint64_t>& dataHashes, std::unordered_map<uint32_t, AssetHash>& hashes)
+{
+    hashes.reserve(hip.pcnt.assetCount);
+    for (uint32_t i = 0; i < hip.pcnt.assetCount; i++) {
+        AssetHash h;
+        h.offset = hip.ahdr[i].offset;
+        h.size = hip.ahdr[i].size;
+        h.checksum = hip.adbg[i].checksum;
+        h.hash = dataHashes[i];
+        hashes[hip.ahdr[i].id] = h;
+    }
+}
+
+// A git object name, all zeros for working tree files that aren't in the object database
+static bool isBlobHash(const char* hex)
+{
+    size_t len = strlen(hex);
+    if (len != 40 && len != 64) return false;
+
+    bool zero = true;
+    for (size_t i = 0; i < len; i++) {
+        if (!isxdigit((unsigned char)hex[i])) return false;
+        if (hex[i] != '0') zero = false;
+    }
+    return !zero;
+}
+
+static bool isNullPath(const char* path)
+{
+    return !strcmp(path, "/dev/null") || !Stricmp(path, "nul");
+}
+
+static void makeDirectory(const char* path)
+{
+#ifdef _WIN32
+    _mkdir(path);
+#else
+    mkdir(path, 0777);
+#endif
+}
+
+// Read one side of a git diff. Added and deleted files are diffed against an empty file.
+// With --cache, each blob is parsed and hashed once and later runs load the result
+static bool readGitHip(Hip& hip, const char* path, const char* blobHash, std::unordered_map<uint32_t, AssetHash>& hashes)
+{
+    if (isNullPath(path)) return true;
+
+    std::string cachePath;
+    if (compareHashes && isBlobHash(blobHash)) {
+        cachePath = std::string(cacheDir) + "/" + blobHash + ".hipc";
+
+        std::vector<uint64_t> dataHashes;
+        if (hip.readCache(cachePath.c_str(), dataHashes)) {
+            setAssetHashes(hip, dataHashes, hashes);
+            return true;
+        }
+    }
+
+    if (!readHip(hip, path)) return false;
+    if (!compareHashes) return true;
+
+    updateAssetHashes(hip, hashes);
+
+    if (!cachePath.empty()) {
+        std::vector<uint64_t> dataHashes(hip.pcnt.assetCount);
+        for (uint32_t i = 0; i < hip.pcnt.assetCount; i++) {
+            dataHashes[i] = hashes.find(hip.ahdr[i].id)->second.hash;
+        }
+        hip.writeCache(cachePath.c_str(), dataHashes);
+    }
+
+    return true;
+}
+
+// Stable line per field dump of one file for git's textconv. Offsets and pluses shift
+// whenever anything before them changes, so they're only included with -o and -p
+static void printHipText(Hip& hip)
+{
+    char type[5];
+
+    printf("PVER subVersion 0x%X clientVersion 0x%X compatVersion 0x%X\n", hip.pver.subVersion, hip.pver.clientVersion, hip.pver.compatVersion);
+    printf("PFLG flags 0x%X\n", hip.pflg.flags);
+    printf("PCNT assetCount %d layerCount %d maxAssetSize %d maxLayerSize %d maxXformAssetSize %d\n",
+           hip.pcnt.assetCount, hip.pcnt.layerCount, hip.pcnt.maxAssetSize, hip.pcnt.maxLayerSize, hip.pcnt.maxXformAssetSize);
+    printf("PCRT time %d \"%s\"\n", hip.pcrt.time, hip.pcrt.string);
+    printf("PMOD time %d\n", hip.pmod.time);
+    if (hip.plat.exists) {
+        printf("PLAT id 0x%08X", hip.plat.id);
+        for (int i = 0; i < hip.plat.stringCount; i++) {
+            printf(" \"%s\"", hip.plat.strings[i]);
+        }
+        printf("\n");
+    }
+
+    printf("AINF %d\n", hip.ainf.ainf);
+    for (uint32_t i = 0; i < hip.pcnt.assetCount; i++) {
+        const Hip::AHDR& ahdr = hip.ahdr[i];
+        const Hip::ADBG& adbg = hip.adbg[i];
+        printf("AHDR 0x%08X %s size %d flags 0x%08X align %d checksum 0x%08X data %016llX",
+               ahdr.id, typeString(ahdr.type, type), ahdr.size, ahdr.flags, adbg.align, adbg.checksum,
+               (unsigned long long)relocTable.hashData(ahdr));
+        if (diffOffsets) printf(" offset %d", ahdr.offset);
+        if (diffPluses) printf(" plus %d", ahdr.plus);
+        printf(" \"%s\" \"%s\"\n", adbg.name, adbg.filename);
+    }
+
+    printf("LINF %d\n", hip.linf.linf);
+    for (uint32_t i = 0; i < hip.pcnt.layerCount; i++) {
+        const Hip::LHDR& lhdr = hip.lhdr[i];
+        printf("LHDR %d type %d assetCount %d ldbg %d\n", i, lhdr.type, lhdr.assetCount, hip.ldbg[i].ldbg);
+        for (uint32_t j = 0; j < lhdr.assetCount; j++) {
+            printf("  0x%08X\n", lhdr.assetIDs[j]);
+        }
+    }
+
+    printf("DHDR %d\n", hip.dhdr.dhdr);
+}
+
+static DiffSink* createSink(OutputBuffer& out)
+{
+    switch (outputFormat) {
+    case OutputFormat::Unified:
+        return new UnifiedTextSink(out);
+    case OutputFormat::Json:
+        return new JsonSink(out);
+    case OutputFormat::Binary:
+        return new BinarySink(out);
+    case OutputFormat::Html:
+        return new HtmlSink(out);
+    default:
+        return new TextColumnSink(out, columnWidth);
+    }
+}
+
+// The output file is closed here unless it's stdout, so a failed write changes the result
+static int finishOutput(OutputBuffer& out, FILE* outFile, int result)
+{
+    if (outFile != stdout && !out.close()) {
+        printf("Could not write file '%s'\n", outputPath);
+        return 1;
+    }
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+#ifdef _WIN32
+    // Enable text coloring in console
+    // https://learn.microsoft.com/en-us/windows/console/console-virtual-terminal-sequences
+
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (hOut == INVALID_HANDLE_VALUE)
+    {
+        return GetLastError();
+    }
+
+    DWORD dwMode = 0;
+    if (!GetConsoleMode(hOut, &dwMode))
+    {
+        return GetLastError();
+    }
+
+    dwMode |= ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+    if (!SetConsoleMode(hOut, dwMode))
+    {
+        return GetLastError();
+    }
+#endif
+
+    if (argc <= 1) {
+        printVersion();
+        printf("\n");
+        printUsage();
+        return 1;
+    }
+
+    bool showHelp = false;
+    bool showVersion = false;
+    bool formatSet = false;
+    std::vector<const char*> paths;
+
+    for (int i = 1; i < argc; i++) {
+        char* arg = argv[i];
+        if (arg[0] == '-' && arg[1]) {
+            if (!Stricmp(arg, "-h")) showHelp = true;
+            else if (!Stricmp(arg, "-v")) showVersion = true;
+            else if (!Stricmp(arg, "-a")) assetDiffsOnly = true;
+            else if (!Stricmp(arg, "-d")) detailedAssets = true;
+            else if (!Stricmp(arg, "-c")) ignoreDataIfChksumMatch = true;
+            else if (!Stricmp(arg, "-o")) diffOffsets = true;
+            else if (!Stricmp(arg, "-p")) diffPluses = true;
+            else if (!Stricmp(arg, "--watch")) watchMode = true;
+            else if (!Stricmp(arg, "--summary")) summaryMode = true;
+            else if (!Stricmp(arg, "--tui")) tuiMode = true;
+            else if (!Stricmp(arg, "--validate")) validateMode = true;
+            else if (!Stricmp(arg, "--verify")) verifyChecksums = true;
+            else if (!Stricmp(arg, "--order")) diffOrder = true;
+            else if (!Stricmp(arg, "--read-ahead")) setIoReadAhead(true);
+            else if (!Stricmp(arg, "--cold")) setIoCold(true);
+            else if (!Stricmp(arg, "--io-stats")) ioStats = true;
+            else if (!Stricmp(arg, "--git-diff")) gitDiffMode = true;
+            else if (!Stricmp(arg, "--level")) levelMode = true;
+            else if (!Stricmp(arg, "--overlay")) overlayMode = true;
+            else if (!Stricmp(arg, "--textconv")) textconvMode = true;
+            else if (!Stricmp(arg, "--ingest")) storeIngestMode = true;
+            else if (!Stricmp(arg, "--restore")) storeRestoreMode = true;
+            else if (!Stricmp(arg, "--store")) {
+                storeDir = (i + 1 < argc) ? argv[i+1] : "";
+                if (!*storeDir) {
+                    printf("Store directory argument missing\n");
+                    printf("\n");
+                    printUsage();
+                    return 1;
+                }
+                i++;
+            }
+            else if (!Stricmp(arg, "--cache")) {
+                cacheDir = (i + 1 < argc) ? argv[i+1] : "";
+                if (!*cacheDir) {
+                    printf("Cache directory argument missing\n");
+                    printf("\n");
+                    printUsage();
+                    return 1;
+                }
+                i++;
+            }
+            else if (!Stricmp(arg, "-j")) {
+                setThreadCount((i + 1 < argc) ? atoi(argv[i+1]) : 0);
+                i++;
+            }
+            else if (!Stricmp(arg, "--io")) {
+                const char* name = (i + 1 < argc) ? argv[i+1] : "";
+                IoBackend backend;
+                if (!parseIoBackend(name, &backend)) {
+                    printf("Unknown I/O backend '%s'\n", name);
+                    printf("\n");
+                    printUsage();
+                    return 1;
+                }
+                if (backend == IoBackend::Uring && !ioUringAvailable()) {
+                    printf("io_uring is not available, reading with pread\n");
+                }
+                setIoBackend(backend);
+                mappedIo = (backend == IoBackend::Mmap);
+                i++;
+            }
+            else if (!Stricmp(arg, "--huge-pages")) {
+                const char* name = (i + 1 < argc) ? argv[i+1] : "";
+                HugePages mode;
+                if (!parseHugePages(name, &mode)) {
+                    printf("Unknown huge page mode '%s'\n", name);
+                    printf("\n");
+                    printUsage();
+                    return 1;
+                }
+                setHugePages(mode);
+                i++;
+            }
+            else if (!Stricmp(arg, "--io-depth")) {
+                int depth = (i + 1 < argc) ? atoi(argv[i+1]) : 0;
+                if (depth <= 0 || depth > IO_MAX_QUEUE_DEPTH) {
+                    printf("Invalid --io-depth (1-%d)\n", IO_MAX_QUEUE_DEPTH);
+                    printf("\n");
+                    printUsage();
+                    return 1;
+                }
+                setIoQueueDepth(depth);
+                i++;
+            }
+            else if (!Stricmp(arg, "--top")) {
+                topCount = (i + 1 < argc) ? atoi(argv[i+1]) : 0;
+                if (topCount <= 0) {
+                    printf("Invalid --top count\n");
+                    printf("\n");
+                    printUsage();
+                    return 1;
+                }
+                i++;
+            }
+            else if (!Stricmp(arg, "--reloc")) {
+                const char* path = (i + 1 < argc) ? argv[i+1] : "";
+                if (!relocTable.load(path)) {
+                    return 1;
+                }
+                i++;
+            }
+            else if (!Stricmp(arg, "--plugin")) {
+                const char* path = (i + 1 < argc) ? argv[i+1] : "";
+                if (!decoders.loadPlugin(path)) {
+                    return 1;
+                }
+                i++;
+            }
+            else if (!Stricmp(arg, "--text")) detectText = true;
+            else if (!Stricmp(arg, "--text-types")) {
+                const char* types = (i + 1 < argc) ? argv[i+1] : "";
+                if (!parseTypeList(types, textTypes)) {
+                    printf("Invalid asset type list '%s'\n", types);
+                    printf("\n");
+                    printUsage();
+                    return 1;
+                }
+                i++;
+            }
+            else if (!Stricmp(arg, "-f")) {
+                const char* format = (i + 1 < argc) ? argv[i+1] : "";
+                formatSet = true;
+                if (!Stricmp(format, "columns")) outputFormat = OutputFormat::Columns;
+                else if (!Stricmp(format, "unified")) outputFormat = OutputFormat::Unified;
+                else if (!Stricmp(format, "json")) outputFormat = OutputFormat::Json;
+                else if (!Stricmp(format, "binary")) outputFormat = OutputFormat::Binary;
+                else if (!Stricmp(format, "html")) outputFormat = OutputFormat::Html;
+                else {
+                    printf("Unknown output format '%s'\n", format);
+                    printf("\n");
+                    printUsage();
+                    return 1;
+                }
+                i++;
+            }
+            else if (!Stricmp(arg, "--html")) {
+                outputFormat = OutputFormat::Html;
+                outputPath = (i + 1 < argc) ? argv[i+1] : "";
+                formatSet = true;
+                i++;
+            }
+            else if (!Stricmp(arg, "--export")) {
+                exportPrefix = (i + 1 < argc) ? argv[i+1] : "";
+                i++;
+            }
+            else if (!Stricmp(arg, "--export-format")) {
+                const char* format = (i + 1 < argc) ? argv[i+1] : "";
+                if (!Stricmp(format, "csv")) exportFormat = ExportFormat::Csv;
+                else if (!Stricmp(format, "columnar")) exportFormat = ExportFormat::Columnar;
+                else {
+                    printf("Unknown export format '%s'\n", format);
+                    printf("\n");
+                    printUsage();
+                    return 1;
+                }
+                i++;
+            }
+            else if (!Stricmp(arg, "-w")) {
+                char* width = argv[i+1];
+                columnWidth = atoi(width);
+                if (columnWidth <= 0) columnWidth = DEFAULT_COLUMN_WIDTH;
+                i++;
+            }
+            else {
+                printf("Unknown option '%s'\n", arg);
+                printf("\n");
+                printUsage();
+                return 1;
+            }
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (showHelp) {
+        printUsage();
+        return 0;
+    }
+
+    if (showVersion) {
+        printVersion();
+        return 0;
+    }
+
+    if (validateMode) {
+        if (paths.empty()) {
+            printf("HIP file argument missing\n");
+            printf("\n");
+            printUsage();
+            return 1;
+        }
+        if (std::count_if(paths.begin(), paths.end(), isStdinPath) > 1) {
+            printf("Only one file can be read from standard input\n");
+            printf("\n");
+            printUsage();
+            return 1;
+        }
+
+        return validateFiles(paths) ? 0 : 1;
+    }
+
+    if ((storeIngestMode || storeRestoreMode) && !storeDir) {
+        printf("--ingest and --restore need --store <dir>\n");
+        printf("\n");
+        printUsage();
+        return 1;
+    }
+
+    if (storeIngestMode || storeRestoreMode) {
+        if (paths.size() != 2) {
+            printf("%s takes a version name and a file\n", storeIngestMode ? "--ingest" : "--restore");
+            printf("\n");
+            printUsage();
+            return 1;
+        }
+
+        bool done = storeIngestMode ? storeIngest(storeDir, paths[0], paths[1]) : storeRestore(storeDir, paths[0], paths[1]);
+        return done ? 0 : 1;
+    }
+
+    if (storeDir) {
+        if (watchMode || gitDiffMode || levelMode || overlayMode || needsAssetData()) {
+            printf("Stored versions are diffed without asset data, which rules out --watch, --git-diff, --level, --overlay, --top, --verify, --reloc, --tui, --text, --text-types and plugins\n");
+            printf("\n");
+            printUsage();
+            return 1;
+        }
+        compareHashes = true;
+    }
+
+    if (textconvMode) {
+        if (paths.size() != 1) {
+            printf("--textconv takes one HIP file\n");
+            printf("\n");
+            printUsage();
+            return 1;
+        }
+
+        Hip hip;
+        if (!readHip(hip, paths[0])) return 1;
+        printHipText(hip);
+        return 0;
+    }
+
+    // git runs the external diff as: path old-file old-hex old-mode new-file new-hex new-mode,
+    // followed by the new path and a rename message for renames
+    std::string gitOldName;
+    std::string gitNewName;
+    const char* gitOldHash = nullptr;
+    const char* gitNewHash = nullptr;
+    if (gitDiffMode) {
+        if (paths.size() != 7 && paths.size() != 9) {
+            printf("--git-diff expects the 7 or 9 arguments git passes to GIT_EXTERNAL_DIFF\n");
+            printf("\n");
+            printUsage();
+            return 1;
+        }
+
+        gitOldName = std::string("a/") + paths[0];
+        gitNewName = std::string("b/") + paths[paths.size() == 9 ? 7 : 0];
+        gitOldHash = paths[2];
+        gitNewHash = paths[5];
+        paths = { paths[1], paths[4] };
+
+        if (!formatSet) outputFormat = OutputFormat::Unified;
+        watchMode = false;
+        tuiMode = false;
+        compareHashes = cacheDir && !needsAssetData();
+        if (compareHashes) makeDirectory(cacheDir);
+    }
+
+    if (watchMode && summaryMode) {
+        printf("--summary can't be combined with --watch\n");
+        printf("\n");
+        printUsage();
+        return 1;
+    }
+
+    if (watchMode && exportPrefix) {
+        printf("--export can't be combined with --watch\n");
+        printf("\n");
+        printUsage();
+        return 1;
+    }
+
+    // A watched file is rewritten by other tools, and a mapping of a file truncated under it
+    // faults on access
+    if (watchMode && mappedIo) {
+        printf("--io mmap can't be combined with --watch\n");
+        printf("\n");
+        printUsage();
+        return 1;
+    }
+
+    // Archives of the original side followed by those of the modified side, with the
+    // names their assets' sources are reported by
+    std::vector<std::string> archivePaths;
+    std::vector<std::string> archiveLabels;
+    uint32_t oarchiveCount = 0;
+    if (levelMode || overlayMode) {
+        if (watchMode || gitDiffMode || (levelMode && overlayMode)) {
+            printf("--level and --overlay can't be combined with each other, --watch or --git-diff\n");
+            printf("\n");
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (levelMode) {
+        // Original .HIP, .HOP, modified .HIP, .HOP
+        if (paths.size() == 4) {
+            archivePaths.assign(paths.begin(), paths.end());
+            paths = { paths[0], paths[2] };
+        } else if (paths.size() == 2) {
+            archivePaths.resize(4);
+            archivePaths[0] = paths[0];
+            archivePaths[2] = paths[1];
+            for (int i = 0; i < 4; i += 2) {
+                if (!hopPathFromHip(archivePaths[i].c_str(), archivePaths[i + 1])) {
+                    printf("Can't find the HOP file of '%s', pass all four files\n", archivePaths[i].c_str());
+                    printf("\n");
+                    printUsage();
+                    return 1;
+                }
+            }
+        }
+        archiveLabels = { "HIP", "HOP", "HIP", "HOP" };
+        oarchiveCount = 2;
+        archiveMovesTitle = "Moved between HIP and HOP";
+    }
+
+    if (overlayMode && paths.size() == 2) {
+        parseArchiveStack(paths[0], archivePaths);
+        oarchiveCount = (uint32_t)archivePaths.size();
+        parseArchiveStack(paths[1], archivePaths);
+        for (const std::string& path : archivePaths) {
+            archiveLabels.push_back(filenameFromPath(path.c_str()));
+        }
+
+        // Archives are the same archive when their names match. If the two stacks share no
+        // names at all (e.g. nightly builds named by date) and are the same length, they're
+        // paired by position instead, so a renamed archive isn't reported as moved
+        uint32_t marchiveCount = (uint32_t)archiveLabels.size() - oarchiveCount;
+        bool namesShared = false;
+        for (uint32_t i = oarchiveCount; i < archiveLabels.size(); i++) {
+            if (std::find(archiveLabels.begin(), archiveLabels.begin() + oarchiveCount, archiveLabels[i]) !=
+                archiveLabels.begin() + oarchiveCount) {
+                namesShared = true;
+            }
+        }
+        if (!namesShared && marchiveCount == oarchiveCount) {
+            for (uint32_t i = 0; i < oarchiveCount; i++) {
+                std::string& olabel = archiveLabels[i];
+                std::string& mlabel = archiveLabels[oarchiveCount + i];
+                if (olabel != mlabel) {
+                    olabel += "|" + mlabel;
+                    mlabel = olabel;
+                }
+            }
+        }
+    }
+
+    if (paths.size() > 2) {
+        printf("Too many arguments: '%s'\n", paths[2]);
+        printf("\n");
+        printUsage();
+        return 1;
+    }
+
+    if (paths.size() == 0) {
+        printf("Original HIP file argument missing\n");
+        printf("\n");
+        printUsage();
+        return 1;
+    } else if (paths.size() == 1) {
+        printf("Modified HIP file argument missing\n");
+        printf("\n");
+        printUsage();
+        return 1;
+    }
+
+    const char* opath = paths[0];
+    const char* mpath = paths[1];
+    assert(opath);
+    assert(mpath);
+
+    if (!gitDiffMode && !storeDir) {
+        size_t stdinCount = isStdinPath(opath) + isStdinPath(mpath);
+        if (!archivePaths.empty()) {
+            stdinCount = std::count_if(archivePaths.begin(), archivePaths.end(), [](const std::string& path) { return isStdinPath(path.c_str()); });
+        }
+        if (stdinCount > 1) {
+            printf("Only one file can be read from standard input\n");
+            printf("\n");
+            printUsage();
+            return 1;
+        }
+        if (watchMode && isStdinPath(mpath)) {
+            printf("--watch needs a modified file to watch, not standard input\n");
+            printf("\n");
+            printUsage();
+            return 1;
+        }
+    }
+
+    // Details are computed on demand when browsing
+    if (tuiMode) {
+        detailedAssets = false;
+        topCount = 0;
+    }
+
+#ifdef _WIN32
+    if (outputFormat == OutputFormat::Binary) {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+
+    FILE* outFile = stdout;
+    if (outputPath) {
+        fopen_s(&outFile, outputPath, "wb");
+        if (!outFile) {
+            printf("Could not open file '%s'\n", outputPath);
+            return 1;
+        }
+    }
+
+    static OutputBuffer out(outFile);
+    DiffSink* sink = createSink(out);
+
+    auto readStartTime = std::chrono::steady_clock::now();
+    uint64_t readStartBytes = ioBytesRead();
+
+    // Sources of ohip and mhip in level and overlay mode, in archivePaths order
+    std::unique_ptr<Hip[]> archives(new Hip[archivePaths.size()]);
+    if (!archivePaths.empty() && !readArchives(archives.get(), archivePaths)) return finishOutput(out, outFile, 1);
+
+    uint32_t marchiveCount = (uint32_t)archivePaths.size() - oarchiveCount;
+
+    Hip sides[2];
+    Hip& ohip = sides[0];
+    if (!archivePaths.empty()) {
+        combineArchives(ohip, &archives[0], &archiveLabels[0], oarchiveCount, oarchiveSources);
+    } else if (gitDiffMode) {
+        if (!readGitHip(ohip, opath, gitOldHash, oassetHashes)) return finishOutput(out, outFile, 1);
+    } else if (storeDir) {
+        std::vector<uint64_t> dataHashes;
+        if (!storeLoad(storeDir, opath, ohip, dataHashes)) return finishOutput(out, outFile, 1);
+        hackPCRTString(ohip.pcrt.string); // Stored as ingested, before readHip would have trimmed it
+        setAssetHashes(ohip, dataHashes, oassetHashes);
+    } else if (!watchMode) {
+        // Both at once, so two piped inputs are parsed side by side as they're written. When the
+        // diff is printed as text, its header sections don't wait for the asset data. Other
+        // formats are read by programs, which need the whole document or none of it
+        EarlyHeaders early;
+        early.hips = sides;
+        early.tablesRead = 0;
+        early.sink = sink;
+        early.out = &out;
+        early.oname = opath;
+        early.mname = mpath;
+        bool printsText = (outputFormat == OutputFormat::Columns || outputFormat == OutputFormat::Unified)
+                       && !exportPrefix && !summaryMode && !tuiMode;
+        if (!readArchives(sides, { opath, mpath }, printsText ? &early : nullptr)) {
+            // Close the diff that was started, with what was compared before the read failed
+            if (headersPrinted) sink->end(additionCount, deletionCount, modificationCount);
+            return finishOutput(out, outFile, 1);
+        }
+    } else {
+        if (!readHip(ohip, opath)) return finishOutput(out, outFile, 1);
+    }
+
+    if (!watchMode) {
+        Hip& mhip = sides[1]; // Already read along with ohip from plain files
+        if (!archivePaths.empty()) {
+            combineArchives(mhip, &archives[oarchiveCount], &archiveLabels[oarchiveCount], marchiveCount, marchiveSources);
+        } else if (gitDiffMode) {
+            if (!readGitHip(mhip, mpath, gitNewHash, massetHashes)) return finishOutput(out, outFile, 1);
+        } else if (storeDir) {
+            std::vector<uint64_t> dataHashes;
+            if (!storeLoad(storeDir, mpath, mhip, dataHashes)) return finishOutput(out, outFile, 1);
+            hackPCRTString(mhip.pcrt.string);
+            setAssetHashes(mhip, dataHashes, massetHashes);
+        }
+        if (ioStats) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - readStartTime).count();
+            printIoStats(ioBytesRead() - readStartBytes, seconds);
+        }
+        if (verifyChecksums) {
+            verifyAssetChecksums(ohip, oassetChecksums);
+            verifyAssetChecksums(mhip, massetChecksums);
+        }
+
+        if (exportPrefix) {
+            AssetClassification classification;
+            classifyAssets(ohip, mhip, classification);
+            bool exported = exportHips(ohip, mhip, classification, exportPrefix, exportFormat);
+
+            delete sink;
+            return finishOutput(out, outFile, exported ? 0 : 1);
+        }
+
+        if (summaryMode) {
+            std::map<uint32_t, TypeSummary> summaries;
+            summarizeHips(ohip, mhip, summaries);
+            printTypeSummaries(out, summaries);
+
+            delete sink;
+            return finishOutput(out, outFile, 0);
+        }
+
+        auto diffStartTime = std::chrono::steady_clock::now();
+        diffHips(ohip, mhip);
+        if (ioStats) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - diffStartTime).count();
+            fprintf(stderr, "Compared in %.3f s\n", seconds);
+        }
+
+        if (tuiMode) {
+            std::vector<TuiItem> items;
+            buildTuiItems(ohip, mhip, items);
+            if (runTui(opath, mpath, items)) {
+                delete sink;
+                return finishOutput(out, outFile, 0);
+            }
+            printf("--tui needs an interactive terminal, printing the diff instead\n");
+        }
+
+        if (gitDiffMode) {
+            printDiffResults(*sink, gitOldName.c_str(), gitNewName.c_str());
+        } else {
+            printDiffResults(*sink, opath /*filenameFromPath(opath)*/, mpath /*filenameFromPath(mpath)*/);
+        }
+
+        delete sink;
+        return finishOutput(out, outFile, 0);
+    }
+
+    FileWatcher watcher;
+    if (!watcher.open(mpath)) {
+        printf("Could not watch file '%s'\n", mpath);
+        return finishOutput(out, outFile, 1);
+    }
+
+    // The original file is only parsed and hashed once
+    if (verifyChecksums) verifyAssetChecksums(ohip, oassetChecksums);
+    compareHashes = true;
+    updateAssetHashes(ohip, oassetHashes);
+
+    // Only text is redrawn in place. Other formats are read by programs, so the screen isn't
+    // cleared and the status lines go to stderr
+    bool textOutput = (outputFormat == OutputFormat::Columns || outputFormat == OutputFormat::Unified);
+    FILE* status = textOutput ? stdout : stderr;
+
+    while (true) {
+        auto startTime = std::chrono::steady_clock::now();
+        uint64_t startBytes = ioBytesRead();
+
+        Hip mhip;
+        if (readHip(mhip, mpath)) {
+            double readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            uint64_t readBytes = ioBytesRead() - startBytes;
+
+            int hashCount = updateAssetHashes(mhip, massetHashes);
+            if (verifyChecksums) verifyAssetChecksums(mhip, massetChecksums);
+
+            resetDiffs();
+            diffHips(ohip, mhip);
+
+            auto endTime = std::chrono::steady_clock::now();
+            long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+
+            if (textOutput) {
+                printf(CLEAR);
+                fflush(stdout);
+            }
+            printDiffResults(*sink, opath, mpath);
+            fprintf(status, "Rehashed %d of %d asset(s) in %lld ms\n", hashCount, mhip.pcnt.assetCount, ms);
+            fflush(status);
+            if (ioStats) printIoStats(readBytes, readSeconds); // After the screen is cleared
+        }
+
+        fprintf(status, "\n");
+        fprintf(status, "Watching '%s' for changes (Ctrl+C to quit)\n", mpath);
+        fflush(status);
+
+        mhip.close();
+
+        if (!watcher.wait()) {
+            printf("Could not watch file '%s'\n", mpath);
+            return finishOutput(out, outFile, 1);
+        }
+    }
+
+    return finishOutput(out, outFile, 0);
+}
@@ -0,0 +1,130 @@
+#include "myers.h"
+
+// http://www.xmailserver.org/diff2.pdf
+
+static void lcs(const uint32_t* a, int aBegin, int aEnd, const uint32_t* b, int bBegin, int bEnd,
+                std::vector<std::pair<int, int>>& matches);
+
+// Find where the forward and reverse D-paths meet and split the problem there
+static void bisect(const uint32_t* a, int aBegin, int aEnd, const uint32_t* b, int bBegin, int bEnd,
+                   std::vector<std::pair<int, int>>& matches)
+{
+    const uint32_t* sa = a + aBegin;
+    const uint32_t* sb = b + bBegin;
+    int n = aEnd - aBegin;
+    int m = bEnd - bBegin;
+
+    int maxD = (n + m + 1) / 2;
+    int vOffset = maxD;
+    int vLength = 2 * maxD + 2;
+
+    // v1 holds the furthest x reached forward on each diagonal, v2 the same going backward
+    std::vector<int> v1(vLength, -1);
+    std::vector<int> v2(vLength, -1);
+    v1[vOffset + 1] = 0;
+    v2[vOffset + 1] = 0;
+
+    int delta = n - m;
+    bool front = (delta & 1) != 0;
+    int k1start = 0, k1end = 0;
+    int k2start = 0, k2end = 0;
+
+    for (int d = 0; d < maxD; d++) {
+        for (int k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+            int k1Offset = vOffset + k1;
+            int x1;
+            if (k1 == -d || (k1 != d && v1[k1Offset - 1] < v1[k1Offset + 1])) {
+                x1 = v1[k1Offset + 1];
+            } else {
+                x1 = v1[k1Offset - 1] + 1;
+            }
+            int y1 = x1 - k1;
+            while (x1 < n && y1 < m && sa[x1] == sb[y1]) {
+                x1++;
+                y1++;
+            }
+            v1[k1Offset] = x1;
+
+            if (x1 > n) {
+                k1end += 2;
+            } else if (y1 > m) {
+                k1start += 2;
+            } else if (front) {
+                int k2Offset = vOffset + delta - k1;
+                if (k2Offset >= 0 && k2Offset < vLength && v2[k2Offset] != -1) {
+                    int x2 = n - v2[k2Offset];
+                    if (x1 >= x2) {
+                        lcs(a, aBegin, aBegin + x1, b, bBegin, bBegin + y1, matches);
+                        lcs(a, aBegin + x1, aEnd, b, bBegin + y1, bEnd, matches);
+                        return;
+                    }
+                }
+            }
+        }
+
+        for (int k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+            int k2Offset = vOffset + k2;
+            int x2;
+            if (k2 == -d || (k2 != d && v2[k2Offset - 1] < v2[k2Offset + 1])) {
+                x2 = v2[k2Offset + 1];
+            } else {
+                x2 = v2[k2Offset - 1] + 1;
+            }
+            int y2 = x2 - k2;
+            while (x2 < n && y2 < m && sa[n - x2 - 1] == sb[m - y2 - 1]) {
+                x2++;
+                y2++;
+            }
+            v2[k2Offset] = x2;
+
+            if (x2 > n) {
+                k2end += 2;
+            } else if (y2 > m) {
+                k2start += 2;
+            } else if (!front) {
+                int k1Offset = vOffset + delta - k2;
+                if (k1Offset >= 0 && k1Offset < vLength && v1[k1Offset] != -1) {
+                    int x1 = v1[k1Offset];
+                    int y1 = vOffset + x1 - k1Offset;
+                    if (x1 >= n - x2) {
+                        lcs(a, aBegin, aBegin + x1, b, bBegin, bBegin + y1, matches);
+                        lcs(a, aBegin + x1, aEnd, b, bBegin + y1, bEnd, matches);
+                        return;
+                    }
+                }
+            }
+        }
+    }
+
+    // Nothing in common
+}
+
+static void lcs(const uint32_t* a, int aBegin, int aEnd, const uint32_t* b, int bBegin, int bEnd,
+                std::vector<std::pair<int, int>>& matches)
+{
+    // Common prefix
+    while (aBegin < aEnd && bBegin < bEnd && a[aBegin] == b[bBegin]) {
+        matches.push_back(std::make_pair(aBegin, bBegin));
+        aBegin++;
+        bBegin++;
+    }
+
+    // Common suffix (matched after the middle so the pairs stay in order)
+    int suffix = 0;
+    while (aBegin < aEnd - suffix && bBegin < bEnd - suffix && a[aEnd - suffix - 1] == b[bEnd - suffix - 1]) {
+        suffix++;
+    }
+
+    if (aBegin < aEnd - suffix && bBegin < bEnd - suffix) {
+        bisect(a, aBegin, aEnd - suffix, b, bBegin, bEnd - suffix, matches);
+    }
+
+    for (int i = suffix; i > 0; i--) {
+        matches.push_back(std::make_pair(aEnd - i, bEnd - i));
+    }
+}
+
+void myersLCS(const uint32_t* a, int n, const uint32_t* b, int m, std::vector<std::pair<int, int>>& matches)
+{
+    lcs(a, 0, n, b, 0, m, matches);
+}
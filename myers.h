@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+// Longest common subsequence of two sequences of 32-bit values (asset IDs, line hashes),
+// using Myers' O(ND) diff with the linear-space middle snake bisection.
+// Appends the matched (a index, b index) pairs to matches in increasing order
+void myersLCS(const uint32_t* a, int n, const uint32_t* b, int m, std::vector<std::pair<int, int>>& matches);
@@ -0,0 +1,475 @@
+#include "output.h"
+
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+
+// Max length of a single formatted diff side
+#define DIFF_TEXT_SIZE 256
+
+static bool hasSide(const Diff& diff, bool left)
+{
+    if (left) return diff.type != Diff::Type::Addition;
+    return diff.type != Diff::Type::Deletion;
+}
+
+int diffDepth(const Diff& diff)
+{
+    int spaces = 0;
+    while (diff.fmt[spaces] == ' ') spaces++;
+    return spaces / 2;
+}
+
+int formatDiffSide(const Diff& diff, bool left, char* buf, size_t bufsize)
+{
+    assert(bufsize > 0);
+
+    if (!hasSide(diff, left)) {
+        buf[0] = '\0';
+        return 0;
+    }
+
+    const DiffValue& value = left ? diff.left : diff.right;
+
+    int n;
+    switch (value.kind) {
+    case DiffValue::Kind::Int:
+        n = snprintf(buf, bufsize, diff.fmt, value.i);
+        break;
+    case DiffValue::Kind::String:
+        n = snprintf(buf, bufsize, diff.fmt, value.s);
+        break;
+    default:
+        n = snprintf(buf, bufsize, diff.fmt, nullptr);
+        break;
+    }
+
+    if (n < 0) {
+        buf[0] = '\0';
+        return 0;
+    }
+    if ((size_t)n >= bufsize) n = (int)(bufsize - 1);
+
+    return n;
+}
+
+OutputBuffer::OutputBuffer(FILE* file) : file(file), size(0)
+{
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    flush();
+}
+
+void OutputBuffer::write(const void* data, size_t size)
+{
+    if (this->size + size > OUTPUT_BUFFER_SIZE) {
+        flush();
+        if (size > OUTPUT_BUFFER_SIZE) {
+            fwrite(data, 1, size, file);
+            return;
+        }
+    }
+
+    memcpy(buf + this->size, data, size);
+    this->size += size;
+}
+
+void OutputBuffer::writeString(const char* str)
+{
+    write(str, strlen(str));
+}
+
+void OutputBuffer::writeChar(char c)
+{
+    if (size >= OUTPUT_BUFFER_SIZE) flush();
+    buf[size++] = c;
+}
+
+void OutputBuffer::writef(const char* fmt, ...)
+{
+    char* p = reserve(DIFF_TEXT_SIZE);
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(p, DIFF_TEXT_SIZE, fmt, args);
+    va_end(args);
+
+    if (n < 0) n = 0;
+    if (n >= DIFF_TEXT_SIZE) n = DIFF_TEXT_SIZE - 1;
+    commit(n);
+}
+
+char* OutputBuffer::reserve(size_t size)
+{
+    assert(size <= OUTPUT_BUFFER_SIZE);
+    if (this->size + size > OUTPUT_BUFFER_SIZE) flush();
+    return buf + this->size;
+}
+
+void OutputBuffer::commit(size_t size)
+{
+    assert(this->size + size <= OUTPUT_BUFFER_SIZE);
+    this->size += size;
+}
+
+void OutputBuffer::flush()
+{
+    if (!file) return;
+    if (size) {
+        fwrite(buf, 1, size, file);
+        size = 0;
+    }
+    fflush(file);
+}
+
+bool OutputBuffer::close()
+{
+    if (!file) return true;
+    flush();
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) ok = false;
+    file = nullptr;
+    return ok;
+}
+
+TextColumnSink::TextColumnSink(OutputBuffer& out, int columnWidth) : out(out), columnWidth(columnWidth)
+{
+}
+
+void TextColumnSink::writeCell(const char* str)
+{
+    int n = (int)strlen(str);
+    out.write(str, n);
+    for (; n < columnWidth; n++) out.writeChar(' ');
+}
+
+void TextColumnSink::writeCell(const Diff& diff, bool left)
+{
+    int n = formatDiffSide(diff, left, out.reserve(DIFF_TEXT_SIZE), DIFF_TEXT_SIZE);
+    out.commit(n);
+    for (; n < columnWidth; n++) out.writeChar(' ');
+}
+
+void TextColumnSink::begin(const char* oname, const char* mname)
+{
+    int onameWidth = (int)(strlen(oname) + 1);
+    int mnameWidth = (int)(strlen(oname) + 1);
+    if (onameWidth > columnWidth) columnWidth = onameWidth;
+    if (mnameWidth > columnWidth) columnWidth = mnameWidth;
+
+    writeCell(oname);
+    writeCell(mname);
+    out.writeChar('\n');
+    for (int i = 0; i < columnWidth * 2; i++) out.writeChar('=');
+    out.writeChar('\n');
+}
+
+void TextColumnSink::section(const char* title, int count)
+{
+    if (count == -1) {
+        writeCell(title);
+        writeCell(title);
+    } else {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s (%d)", title, count);
+        writeCell(buf);
+        writeCell(buf);
+    }
+    out.writeChar('\n');
+}
+
+void TextColumnSink::diff(const Diff& diff)
+{
+    switch (diff.type) {
+    case Diff::Type::Addition:
+        out.writeString(GRN);
+        break;
+    case Diff::Type::Deletion:
+        out.writeString(RED);
+        break;
+    case Diff::Type::Modification:
+        out.writeString(YEL);
+        break;
+    }
+    writeCell(diff, true);
+    writeCell(diff, false);
+    out.writeChar('\n');
+    out.writeString(RESET);
+}
+
+void TextColumnSink::end(int additionCount, int deletionCount, int modificationCount)
+{
+    out.writeChar('\n');
+    out.writef("%d addition(s), %d deletion(s), %d modification(s)\n",
+               additionCount, deletionCount, modificationCount);
+    out.flush();
+}
+
+UnifiedTextSink::UnifiedTextSink(OutputBuffer& out) : out(out)
+{
+}
+
+void UnifiedTextSink::writeLine(char prefix, const char* color, const Diff& diff, bool left)
+{
+    out.writeString(color);
+    out.writeChar(prefix);
+    int n = formatDiffSide(diff, left, out.reserve(DIFF_TEXT_SIZE), DIFF_TEXT_SIZE);
+    out.commit(n);
+    out.writeString(RESET);
+    out.writeChar('\n');
+}
+
+void UnifiedTextSink::begin(const char* oname, const char* mname)
+{
+    out.writeString("--- ");
+    out.writeString(oname);
+    out.writeString("\n+++ ");
+    out.writeString(mname);
+    out.writeChar('\n');
+}
+
+void UnifiedTextSink::section(const char* title, int count)
+{
+    out.writeString(CYN);
+    if (count == -1) {
+        out.writef("@@ %s @@", title);
+    } else {
+        out.writef("@@ %s (%d) @@", title, count);
+    }
+    out.writeString(RESET);
+    out.writeChar('\n');
+}
+
+void UnifiedTextSink::diff(const Diff& diff)
+{
+    if (diff.type != Diff::Type::Addition) writeLine('-', RED, diff, true);
+    if (diff.type != Diff::Type::Deletion) writeLine('+', GRN, diff, false);
+}
+
+void UnifiedTextSink::end(int additionCount, int deletionCount, int modificationCount)
+{
+    out.writeChar('\n');
+    out.writef("%d addition(s), %d deletion(s), %d modification(s)\n",
+               additionCount, deletionCount, modificationCount);
+    out.flush();
+}
+
+JsonSink::JsonSink(OutputBuffer& out) : out(out), inSection(false), firstDiff(false)
+{
+}
+
+void JsonSink::writeJsonString(const char* str)
+{
+    out.writeChar('"');
+    for (const unsigned char* c = (const unsigned char*)str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            out.writeChar('\\');
+            out.writeChar(*c);
+        } else if (*c < 0x20 || *c >= 0x7F) {
+            // HIP strings aren't guaranteed to be UTF-8, so treat bytes as Latin-1
+            out.writef("\\u%04X", *c);
+        } else {
+            out.writeChar(*c);
+        }
+    }
+    out.writeChar('"');
+}
+
+void JsonSink::writeJsonValue(const DiffValue& value)
+{
+    if (value.kind == DiffValue::Kind::Int) {
+        out.writef("%u", value.i);
+    } else {
+        writeJsonString(value.s);
+    }
+}
+
+void JsonSink::begin(const char* oname, const char* mname)
+{
+    out.writeString("{\"original\":");
+    writeJsonString(oname);
+    out.writeString(",\"modified\":");
+    writeJsonString(mname);
+    out.writeString(",\"sections\":[");
+    inSection = false;
+}
+
+void JsonSink::section(const char* title, int count)
+{
+    if (inSection) out.writeString("\n]},");
+
+    out.writeString("\n{\"title\":");
+    writeJsonString(title);
+    if (count != -1) out.writef(",\"count\":%d", count);
+    out.writeString(",\"diffs\":[");
+
+    inSection = true;
+    firstDiff = true;
+}
+
+void JsonSink::diff(const Diff& diff)
+{
+    static const char* typeNames[] = { "addition", "deletion", "modification" };
+
+    if (!firstDiff) out.writeChar(',');
+    firstDiff = false;
+
+    out.writeString("\n{\"type\":\"");
+    out.writeString(typeNames[(int)diff.type]);
+    out.writef("\",\"depth\":%d", diffDepth(diff));
+
+    char buf[DIFF_TEXT_SIZE];
+    if (hasSide(diff, true)) {
+        formatDiffSide(diff, true, buf, sizeof(buf));
+        out.writeString(",\"left\":");
+        writeJsonString(buf + strspn(buf, " "));
+        if (diff.left.kind != DiffValue::Kind::None) {
+            out.writeString(",\"old\":");
+            writeJsonValue(diff.left);
+        }
+    }
+    if (hasSide(diff, false)) {
+        formatDiffSide(diff, false, buf, sizeof(buf));
+        out.writeString(",\"right\":");
+        writeJsonString(buf + strspn(buf, " "));
+        if (diff.right.kind != DiffValue::Kind::None) {
+            out.writeString(",\"new\":");
+            writeJsonValue(diff.right);
+        }
+    }
+    out.writeChar('}');
+}
+
+void JsonSink::end(int additionCount, int deletionCount, int modificationCount)
+{
+    if (inSection) out.writeString("\n]}");
+    inSection = false;
+
+    out.writef("\n],\"additions\":%d,\"deletions\":%d,\"modifications\":%d}\n",
+               additionCount, deletionCount, modificationCount);
+    out.flush();
+}
+
+BinarySink::BinarySink(OutputBuffer& out) : out(out)
+{
+}
+
+void BinarySink::writeU8(uint8_t x)
+{
+    out.writeChar((char)x);
+}
+
+void BinarySink::writeU16(uint16_t x)
+{
+    uint8_t b[2] = { (uint8_t)x, (uint8_t)(x >> 8) };
+    out.write(b, sizeof(b));
+}
+
+void BinarySink::writeU32(uint32_t x)
+{
+    uint8_t b[4] = { (uint8_t)x, (uint8_t)(x >> 8), (uint8_t)(x >> 16), (uint8_t)(x >> 24) };
+    out.write(b, sizeof(b));
+}
+
+void BinarySink::writeStr(const char* str)
+{
+    size_t len = strlen(str);
+    if (len > 0xFFFF) len = 0xFFFF;
+    writeU16((uint16_t)len);
+    out.write(str, len);
+}
+
+void BinarySink::writeValue(const DiffValue& value)
+{
+    switch (value.kind) {
+    case DiffValue::Kind::Int:
+        writeU8(1);
+        writeU32(value.i);
+        break;
+    case DiffValue::Kind::String:
+        writeU8(2);
+        writeStr(value.s);
+        break;
+    default:
+        writeU8(0);
+        break;
+    }
+}
+
+void BinarySink::begin(const char* oname, const char* mname)
+{
+    out.write("HDIF", 4);
+    writeU32(1);
+
+    writeU8('B');
+    writeStr(oname);
+    writeStr(mname);
+}
+
+void BinarySink::section(const char* title, int count)
+{
+    writeU8('S');
+    writeStr(title);
+    writeU32((uint32_t)count);
+}
+
+void BinarySink::diff(const Diff& diff)
+{
+    writeU8('D');
+    writeU8((uint8_t)diff.type);
+    writeU8((uint8_t)diffDepth(diff));
+    writeStr(diff.fmt + strspn(diff.fmt, " "));
+    writeValue(hasSide(diff, true) ? diff.left : diffValue(nullptr));
+    writeValue(hasSide(diff, false) ? diff.right : diffValue(nullptr));
+}
+
+void BinarySink::end(int additionCount, int deletionCount, int modificationCount)
+{
+    writeU8('E');
+    writeU32((uint32_t)additionCount);
+    writeU32((uint32_t)deletionCount);
+    writeU32((uint32_t)modificationCount);
+    out.flush();
+}
+
+CallbackSink::CallbackSink(DiffCallback callback, void* user) : callback(callback), user(user)
+{
+}
+
+void CallbackSink::begin(const char* oname, const char* mname)
+{
+    DiffEvent ev = {};
+    ev.kind = DiffEvent::Kind::Begin;
+    ev.oname = oname;
+    ev.mname = mname;
+    callback(ev, user);
+}
+
+void CallbackSink::section(const char* title, int count)
+{
+    DiffEvent ev = {};
+    ev.kind = DiffEvent::Kind::Section;
+    ev.title = title;
+    ev.count = count;
+    callback(ev, user);
+}
+
+void CallbackSink::diff(const Diff& diff)
+{
+    DiffEvent ev = {};
+    ev.kind = DiffEvent::Kind::Diff;
+    ev.diff = &diff;
+    callback(ev, user);
+}
+
+void CallbackSink::end(int additionCount, int deletionCount, int modificationCount)
+{
+    DiffEvent ev = {};
+    ev.kind = DiffEvent::Kind::End;
+    ev.additionCount = additionCount;
+    ev.deletionCount = deletionCount;
+    ev.modificationCount = modificationCount;
+    callback(ev, user);
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstddef>
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+// https://stackoverflow.com/questions/3585846/color-text-in-terminal-applications-in-unix
+#define RED   "\x1B[31m"
+#define GRN   "\x1B[32m"
+#define YEL   "\x1B[33m"
+#define BLU   "\x1B[34m"
+#define MAG   "\x1B[35m"
+#define CYN   "\x1B[36m"
+#define WHT   "\x1B[37m"
+#define RESET "\x1B[0m"
+
+// A diff value is referenced, not copied: strings point into the Hip they came from,
+// which must outlive the sink call
+struct DiffValue
+{
+    enum class Kind
+    {
+        None,
+        Int,
+        String
+    } kind;
+    union {
+        uint32_t i;
+        const char* s;
+    };
+};
+
+inline DiffValue diffValue(std::nullptr_t)
+{
+    DiffValue v;
+    v.kind = DiffValue::Kind::None;
+    v.s = nullptr;
+    return v;
+}
+
+inline DiffValue diffValue(uint32_t i)
+{
+    DiffValue v;
+    v.kind = DiffValue::Kind::Int;
+    v.i = i;
+    return v;
+}
+
+inline DiffValue diffValue(int i)
+{
+    return diffValue((uint32_t)i);
+}
+
+inline DiffValue diffValue(const char* s)
+{
+    DiffValue v;
+    v.kind = DiffValue::Kind::String;
+    v.s = s;
+    return v;
+}
+
+struct Diff
+{
+    enum class Type
+    {
+        Addition,
+        Deletion,
+        Modification
+    } type;
+    const char* fmt; // printf format (leading spaces are the indentation level), applied to each side
+    DiffValue left;  // Unused for additions
+    DiffValue right; // Unused for deletions
+    uint32_t assetType; // Type of the asset the row is about, 0 for other rows
+};
+
+// Format one side of a diff into buf, returns the number of characters written
+int formatDiffSide(const Diff& diff, bool left, char* buf, size_t bufsize);
+
+// Indentation level of a diff, from the leading spaces of its format
+int diffDepth(const Diff& diff);
+
+// Reusable output buffer shared by all sinks, flushed to the file when full
+class OutputBuffer
+{
+public:
+    OutputBuffer(FILE* file);
+    ~OutputBuffer();
+
+    void write(const void* data, size_t size);
+    void writeString(const char* str);
+    void writeChar(char c);
+    void writef(const char* fmt, ...);
+
+    // Get space for at most size bytes to write into directly, then commit what was used
+    char* reserve(size_t size);
+    void commit(size_t size);
+
+    void flush();
+
+    // Flush and close the file, false if any of it couldn't be written. Nothing is written after
+    bool close();
+
+private:
+    FILE* file;
+    size_t size;
+    char buf[OUTPUT_BUFFER_SIZE];
+};
+
+// Receives the structured diff, in print order
+class DiffSink
+{
+public:
+    virtual ~DiffSink() {}
+
+    virtual void begin(const char* /*oname*/, const char* /*mname*/) {}
+    virtual void section(const char* /*title*/, int /*count*/) {} // count is -1 for header sections
+    virtual void diff(const Diff& diff) = 0;
+    virtual void end(int /*additionCount*/, int /*deletionCount*/, int /*modificationCount*/) {}
+};
+
+// Side-by-side colored columns (default)
+class TextColumnSink : public DiffSink
+{
+public:
+    TextColumnSink(OutputBuffer& out, int columnWidth);
+
+    void begin(const char* oname, const char* mname) override;
+    void section(const char* title, int count) override;
+    void diff(const Diff& diff) override;
+    void end(int additionCount, int deletionCount, int modificationCount) override;
+
+private:
+    OutputBuffer& out;
+    int columnWidth;
+
+    void writeCell(const char* str);
+    void writeCell(const Diff& diff, bool left);
+};
+
+// Unified diff style text, one -/+ line per side
+class UnifiedTextSink : public DiffSink
+{
+public:
+    UnifiedTextSink(OutputBuffer& out);
+
+    void begin(const char* oname, const char* mname) override;
+    void section(const char* title, int count) override;
+    void diff(const Diff& diff) override;
+    void end(int additionCount, int deletionCount, int modificationCount) override;
+
+private:
+    OutputBuffer& out;
+
+    void writeLine(char prefix, const char* color, const Diff& diff, bool left);
+};
+
+// A single JSON document
+class JsonSink : public DiffSink
+{
+public:
+    JsonSink(OutputBuffer& out);
+
+    void begin(const char* oname, const char* mname) override;
+    void section(const char* title, int count) override;
+    void diff(const Diff& diff) override;
+    void end(int additionCount, int deletionCount, int modificationCount) override;
+
+private:
+    OutputBuffer& out;
+    bool inSection;
+    bool firstDiff;
+
+    void writeJsonString(const char* str);
+    void writeJsonValue(const DiffValue& value);
+};
+
+// Binary record stream (all integers little endian):
+//   header:  "HDIF" u32 version
+//   'B':     str oname, str mname
+//   'S':     str title, i32 count
+//   'D':     u8 type, u8 depth, str fmt, value left, value right
+//   'E':     u32 additionCount, u32 deletionCount, u32 modificationCount
+//   str:     u16 length, chars (no terminator)
+//   value:   u8 kind (0 = none, 1 = int, 2 = string), then u32 or str
+class BinarySink : public DiffSink
+{
+public:
+    BinarySink(OutputBuffer& out);
+
+    void begin(const char* oname, const char* mname) override;
+    void section(const char* title, int count) override;
+    void diff(const Diff& diff) override;
+    void end(int additionCount, int deletionCount, int modificationCount) override;
+
+private:
+    OutputBuffer& out;
+
+    void writeU8(uint8_t x);
+    void writeU16(uint16_t x);
+    void writeU32(uint32_t x);
+    void writeStr(const char* str);
+    void writeValue(const DiffValue& value);
+};
+
+// Forwards the raw events to a user callback, without any formatting
+struct DiffEvent
+{
+    enum class Kind
+    {
+        Begin,
+        Section,
+        Diff,
+        End
+    } kind;
+    const char* oname;          // Begin
+    const char* mname;          // Begin
+    const char* title;          // Section
+    int count;                  // Section
+    const struct Diff* diff;    // Diff
+    int additionCount;          // End
+    int deletionCount;          // End
+    int modificationCount;      // End
+};
+
+typedef void (*DiffCallback)(const DiffEvent& event, void* user);
+
+class CallbackSink : public DiffSink
+{
+public:
+    CallbackSink(DiffCallback callback, void* user);
+
+    void begin(const char* oname, const char* mname) override;
+    void section(const char* title, int count) override;
+    void diff(const Diff& diff) override;
+    void end(int additionCount, int deletionCount, int modificationCount) override;
+
+private:
+    DiffCallback callback;
+    void* user;
+};
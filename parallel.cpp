@@ -0,0 +1,163 @@
+#include "parallel.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <deque>
+
+class ThreadPool
+{
+public:
+    ThreadPool();
+    ~ThreadPool();
+
+    void start();
+    void push(std::function<void()> task);
+    bool runOne();
+    void waitForCompletion(std::atomic<int>& pending);
+    void taskDone();
+
+private:
+    std::mutex mutex;
+    std::condition_variable taskCond;
+    std::condition_variable doneCond;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    bool started;
+    bool stopping;
+
+    void workerMain();
+};
+
+static int threadCount = 0;
+static ThreadPool pool;
+
+void setThreadCount(int count)
+{
+    threadCount = count;
+}
+
+int getThreadCount()
+{
+    if (threadCount <= 0) {
+        threadCount = (int)std::thread::hardware_concurrency();
+        if (threadCount <= 0) threadCount = 1;
+    }
+    return threadCount;
+}
+
+int parallelChunkCount(size_t count)
+{
+    size_t chunks = (size_t)getThreadCount();
+    if (chunks > count) chunks = count;
+    return (int)chunks;
+}
+
+ThreadPool::ThreadPool() : started(false), stopping(false)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskCond.notify_all();
+
+    for (std::thread& t : threads) t.join();
+}
+
+void ThreadPool::start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (started) return;
+    started = true;
+
+    // The waiting thread also runs tasks, so it counts as one of the threads
+    int workerCount = getThreadCount() - 1;
+    for (int i = 0; i < workerCount; i++) {
+        threads.emplace_back(&ThreadPool::workerMain, this);
+    }
+}
+
+void ThreadPool::push(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    taskCond.notify_one();
+}
+
+bool ThreadPool::runOne()
+{
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tasks.empty()) return false;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::waitForCompletion(std::atomic<int>& pending)
+{
+    while (pending > 0) {
+        if (runOne()) continue;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        doneCond.wait(lock, [&]() { return pending == 0 || !tasks.empty(); });
+    }
+}
+
+void ThreadPool::taskDone()
+{
+    // Lock so a waiter can't miss the notification between its check and its wait
+    std::lock_guard<std::mutex> lock(mutex);
+    doneCond.notify_all();
+}
+
+void ThreadPool::workerMain()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskCond.wait(lock, [&]() { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+TaskGroup::TaskGroup() : pending(0)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    wait();
+}
+
+void TaskGroup::run(std::function<void()> task)
+{
+    pool.start();
+
+    pending++;
+    pool.push([this, task]() {
+        task();
+        pending--;
+        pool.taskDone();
+    });
+}
+
+void TaskGroup::wait()
+{
+    pool.waitForCompletion(pending);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+#include <functional>
+
+// Number of threads used by parallel passes (0 = one per hardware thread).
+// Must be set before the first parallel call
+void setThreadCount(int count);
+int getThreadCount();
+
+// Runs tasks on the shared worker pool. The thread calling wait() helps run queued
+// tasks, so groups can be nested and a thread count of 1 runs everything inline
+class TaskGroup
+{
+public:
+    TaskGroup();
+    ~TaskGroup();
+
+    void run(std::function<void()> task);
+    void wait();
+
+private:
+    std::atomic<int> pending;
+};
+
+// Number of chunks parallelFor splits count items into (at most one per thread)
+int parallelChunkCount(size_t count);
+
+// Calls fn(begin, end, chunk) for each chunk of [0, count) on the worker pool and
+// returns once all chunks are done. chunk is in [0, parallelChunkCount(count))
+template <class F>
+void parallelFor(size_t count, F fn)
+{
+    int chunks = parallelChunkCount(count);
+    if (chunks <= 1) {
+        if (count) fn((size_t)0, count, 0);
+        return;
+    }
+
+    TaskGroup group;
+    for (int c = 0; c < chunks; c++) {
+        size_t begin = count * c / chunks;
+        size_t end = count * (c + 1) / chunks;
+        group.run([&fn, begin, end, c]() { fn(begin, end, c); });
+    }
+    group.wait();
+}
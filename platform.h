@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdio.h>
+#include <errno.h>
+
+// The MSVC secure CRT functions the code uses, for other compilers
+#ifndef _MSC_VER
+inline int fopen_s(FILE** file, const char* path, const char* mode)
+{
+    *file = fopen(path, mode);
+    return *file ? 0 : errno;
+}
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+// Decoder plugin interface. A plugin is a shared library (.dll/.so) exporting
+//   const HipDiffPlugin* hipdiffGetPlugin(void);
+// which returns the decoders it provides. A decoder turns the "data changed" of two
+// differing payloads of its asset type into a field-level diff.
+//
+// Plain C so plugins can be built with any compiler without rebuilding hipdiff
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HIPDIFF_PLUGIN_VERSION 1
+
+#ifdef _WIN32
+#define HIPDIFF_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define HIPDIFF_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+enum HipDiffFieldType
+{
+    HIPDIFF_FIELD_ADDITION = 0,     // Only right is used
+    HIPDIFF_FIELD_DELETION = 1,     // Only left is used
+    HIPDIFF_FIELD_MODIFICATION = 2  // Both sides are used
+};
+
+// Report one field difference. depth is the nesting level (0 = top level field), the
+// strings are copied before returning
+typedef void (*HipDiffEmitFunc)(void* context, int type, int depth, const char* left, const char* right);
+
+typedef struct HipDiffDecoder
+{
+    uint32_t assetType; // AHDR type, e.g. 'MODL' as 0x4D4F444C
+    const char* name;
+
+    // Diff two payloads already known to differ, calling emit for each difference.
+    // Data is as stored in the HIP (usually big endian). Called from worker threads,
+    // possibly concurrently. Returns 0 if the data could not be decoded
+    int (*diff)(const void* odata, uint32_t osize, const void* mdata, uint32_t msize,
+                HipDiffEmitFunc emit, void* context);
+} HipDiffDecoder;
+
+typedef struct HipDiffPlugin
+{
+    uint32_t version; // HIPDIFF_PLUGIN_VERSION
+    uint32_t decoderCount;
+    const HipDiffDecoder* decoders;
+} HipDiffPlugin;
+
+typedef const HipDiffPlugin* (*HipDiffGetPluginFunc)(void);
+
+#define HIPDIFF_PLUGIN_ENTRY "hipdiffGetPlugin"
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,238 @@
+#include "reloc.h"
+
+#include "hash.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RELOC_SSE2 1
+#endif
+
+#define RELOC_MAX_LINE 1024
+
+static inline uint32_t loadBE(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void storeBE(uint8_t* p, uint32_t x)
+{
+    p[0] = (uint8_t)(x >> 24);
+    p[1] = (uint8_t)(x >> 16);
+    p[2] = (uint8_t)(x >> 8);
+    p[3] = (uint8_t)x;
+}
+
+static inline uint32_t loadLE(const uint8_t* p)
+{
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[0];
+}
+
+static inline void storeLE(uint8_t* p, uint32_t x)
+{
+    p[0] = (uint8_t)x;
+    p[1] = (uint8_t)(x >> 8);
+    p[2] = (uint8_t)(x >> 16);
+    p[3] = (uint8_t)(x >> 24);
+}
+
+#ifdef RELOC_SSE2
+// Reverse the bytes of each 32-bit lane: swap the bytes of each 16-bit half, then the halves
+static inline __m128i byteSwap32(__m128i v)
+{
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+}
+#endif
+
+// Subtract base from count offsets stride bytes apart. Contiguous arrays (stride 4, the
+// usual offset table) are patched 4 at a time with SSE2, everything else one at a time
+template <bool bigEndian>
+static void patchOffsets(uint8_t* p, uint32_t stride, uint32_t count, uint32_t base)
+{
+    uint32_t i = 0;
+
+#ifdef RELOC_SSE2
+    if (stride == 4) {
+        const __m128i sub = _mm_set1_epi32((int)base);
+        for (; i + 4 <= count; i += 4, p += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)p);
+            if (bigEndian) v = byteSwap32(_mm_sub_epi32(byteSwap32(v), sub));
+            else v = _mm_sub_epi32(v, sub);
+            _mm_storeu_si128((__m128i*)p, v);
+        }
+    }
+#endif
+
+    for (; i < count; i++, p += stride) {
+        if (bigEndian) storeBE(p, loadBE(p) - base);
+        else storeLE(p, loadLE(p) - base);
+    }
+}
+
+// Split off the next whitespace separated token, modifies the string
+static char* nextToken(char** str)
+{
+    char* p = *str;
+    while (*p && isspace((unsigned char)*p)) p++;
+    if (!*p) return nullptr;
+
+    char* token = p;
+    while (*p && !isspace((unsigned char)*p)) p++;
+    if (*p) *p++ = '\0';
+    *str = p;
+    return token;
+}
+
+static bool parseNumber(const char* str, uint32_t* x)
+{
+    char* end;
+    unsigned long val = strtoul(str, &end, 0);
+    if (end == str || *end != '\0') return false;
+    *x = (uint32_t)val;
+    return true;
+}
+
+static bool parseField(const char* token, uint32_t* start, uint32_t* stride, uint32_t* count)
+{
+    char str[RELOC_MAX_LINE];
+    snprintf(str, sizeof(str), "%s", token);
+
+    char* parts[3] = { str, nullptr, nullptr };
+    for (int i = 1; i < 3; i++) {
+        char* sep = strchr(parts[i - 1], ':');
+        if (!sep) break;
+        *sep = '\0';
+        parts[i] = sep + 1;
+    }
+
+    *stride = 0;
+    *count = 1;
+    if (!parseNumber(parts[0], start)) return false;
+    if (parts[1]) {
+        if (!parts[2]) return false;
+        if (!parseNumber(parts[1], stride) || !parseNumber(parts[2], count)) return false;
+        if (*stride < 4) return false;
+    }
+    return true;
+}
+
+bool RelocTable::load(const char* path)
+{
+    FILE* file = nullptr;
+    fopen_s(&file, path, "r");
+    if (!file) {
+        fprintf(stderr, "Could not open relocation table %s\n", path);
+        return false;
+    }
+
+    char line[RELOC_MAX_LINE];
+    int lineNum = 0;
+    bool success = true;
+    while (success && fgets(line, sizeof(line), file)) {
+        lineNum++;
+
+        char* comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char* rest = line;
+        char* token = nextToken(&rest);
+        if (!token) continue;
+
+        if (strlen(token) != 4) {
+            fprintf(stderr, "%s:%d: Invalid asset type \"%s\"\n", path, lineNum, token);
+            success = false;
+            break;
+        }
+        uint32_t id = ((uint32_t)(uint8_t)token[0] << 24) | ((uint32_t)(uint8_t)token[1] << 16)
+                    | ((uint32_t)(uint8_t)token[2] << 8) | (uint32_t)(uint8_t)token[3];
+
+        Type& type = types[id];
+        type.bigEndian = true;
+
+        while ((token = nextToken(&rest))) {
+            if (!strcmp(token, "be")) {
+                type.bigEndian = true;
+                continue;
+            }
+            if (!strcmp(token, "le")) {
+                type.bigEndian = false;
+                continue;
+            }
+
+            Field field;
+            if (!parseField(token, &field.start, &field.stride, &field.count)) {
+                fprintf(stderr, "%s:%d: Invalid field \"%s\"\n", path, lineNum, token);
+                success = false;
+                break;
+            }
+            type.fields.push_back(field);
+        }
+    }
+
+    fclose(file);
+    return success;
+}
+
+const RelocTable::Type* RelocTable::findType(uint32_t type) const
+{
+    auto it = types.find(type);
+    return (it != types.end()) ? &it->second : nullptr;
+}
+
+const uint8_t* RelocTable::normalize(const Type& type, const Hip::AHDR& ahdr, std::vector<uint8_t>& buf) const
+{
+    buf.resize(ahdr.size);
+    memcpy(buf.data(), ahdr.data, ahdr.size);
+
+    for (const Field& field : type.fields) {
+        if (field.start > ahdr.size || ahdr.size - field.start < 4) continue;
+
+        // Clamp the array to the fields that fit in the asset
+        uint32_t stride = field.stride ? field.stride : 4;
+        uint32_t fit = (ahdr.size - field.start - 4) / stride + 1;
+        uint32_t count = (field.count && field.count < fit) ? field.count : fit;
+        if (!field.stride) count = 1;
+
+        if (type.bigEndian) patchOffsets<true>(buf.data() + field.start, stride, count, ahdr.offset);
+        else patchOffsets<false>(buf.data() + field.start, stride, count, ahdr.offset);
+    }
+
+    return buf.data();
+}
+
+bool RelocTable::dataEqual(const Hip::AHDR& oahdr, const Hip::AHDR& mahdr) const
+{
+    if (oahdr.size != mahdr.size) return false;
+
+    // Normalizing is a no-op when the asset didn't move
+    const Type* type = findType(oahdr.type);
+    if (!type || oahdr.type != mahdr.type || oahdr.offset == mahdr.offset) {
+        return memcmp(oahdr.data, mahdr.data, oahdr.size) == 0;
+    }
+
+    // Per thread so assets can be compared in parallel
+    static thread_local std::vector<uint8_t> obuf;
+    static thread_local std::vector<uint8_t> mbuf;
+
+    const uint8_t* odata = normalize(*type, oahdr, obuf);
+    const uint8_t* mdata = normalize(*type, mahdr, mbuf);
+    return memcmp(odata, mdata, oahdr.size) == 0;
+}
+
+uint64_t RelocTable::hashData(const Hip::AHDR& ahdr) const
+{
+    if (!ahdr.data) return 0; // Outside of DPAK
+
+    const Type* type = findType(ahdr.type);
+    if (!type) return ::hashData(ahdr.data, ahdr.size);
+
+    static thread_local std::vector<uint8_t> buf;
+    return ::hashData(normalize(*type, ahdr, buf), ahdr.size);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "hip.h"
+
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+// Table of the fields in each asset type that hold absolute file offsets. Adding or
+// resizing one asset shifts the offset of every later one, so these fields change even
+// though nothing really did. Normalizing them to be relative to the asset's own offset
+// makes such assets compare equal.
+//
+// Table file format, one asset type per line ('#' starts a comment):
+//   TYPE [be|le] field...
+// TYPE is the four character asset type (e.g. MODL), data is big endian unless "le" is
+// given, and each field is the byte position of a 32-bit offset in the asset data,
+// either a single position or an array as start:stride:count (count 0 = to the end)
+class RelocTable
+{
+public:
+    bool load(const char* path);
+
+    bool empty() const { return types.empty(); }
+    bool hasType(uint32_t type) const { return types.find(type) != types.end(); }
+
+    // Compare the data of two assets of the same size with offset fields normalized
+    bool dataEqual(const Hip::AHDR& oahdr, const Hip::AHDR& mahdr) const;
+
+    // Hash the data of an asset with offset fields normalized
+    uint64_t hashData(const Hip::AHDR& ahdr) const;
+
+private:
+    struct Field
+    {
+        uint32_t start;
+        uint32_t stride; // 0 for a single field
+        uint32_t count;  // 0 = as many as fit in the asset
+    };
+
+    struct Type
+    {
+        bool bigEndian;
+        std::vector<Field> fields;
+    };
+
+    std::unordered_map<uint32_t, Type> types;
+
+    const Type* findType(uint32_t type) const;
+    const uint8_t* normalize(const Type& type, const Hip::AHDR& ahdr, std::vector<uint8_t>& buf) const;
+};
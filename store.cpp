@@ -0,0 +1,444 @@
+#include "store.h"
+
+#include "hash.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <algorithm>
+#include <string>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Second half of object keys, the first is the plain data hash also used for diffs
+#define STORE_KEY_SEED 0x9E3779B97F4A7C15ull
+#define STORE_COPY_SIZE (1024 * 1024)
+
+struct ObjectKey
+{
+    uint64_t hash[2];
+};
+
+// A run of archive bytes, read from offset in an object
+struct Segment
+{
+    ObjectKey key;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct ManifestHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t archiveSize;
+    uint64_t tablesSize;
+};
+
+static void makeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0777);
+#endif
+}
+
+static bool isValidName(const char* name)
+{
+    if (!*name || *name == '.') return false;
+    for (const char* c = name; *c; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '.' && *c != '-' && *c != '_') return false;
+    }
+    return true;
+}
+
+static std::string manifestPath(const char* dir, const char* name)
+{
+    return std::string(dir) + "/manifests/" + name + ".hipm";
+}
+
+static std::string objectPath(const char* dir, const ObjectKey& key)
+{
+    char hex[33];
+    snprintf(hex, sizeof(hex), "%016llx%016llx", (unsigned long long)key.hash[0], (unsigned long long)key.hash[1]);
+    return std::string(dir) + "/objects/" + std::string(hex, 2) + "/" + hex;
+}
+
+static ObjectKey objectKey(const void* data, size_t size, uint64_t dataHash)
+{
+    ObjectKey key;
+    key.hash[0] = dataHash;
+    key.hash[1] = hashData(data, size, STORE_KEY_SEED);
+    return key;
+}
+
+static long fileSize(FILE* file)
+{
+    if (fseek(file, 0, SEEK_END) != 0) return -1;
+    return ftell(file);
+}
+
+// Files are written under a temporary name and renamed, so readers never see half of one
+static std::string tempPath(const std::string& path)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)getpid());
+    return path + suffix;
+}
+
+static bool commitFile(FILE* out, const std::string& tmpPath, const std::string& path, bool written)
+{
+    if (fclose(out) != 0) written = false;
+
+    // Replacing doesn't work on Windows, remove the old version first
+    if (written) remove(path.c_str());
+    if (!written || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+struct IngestStats
+{
+    uint32_t objectCount = 0;
+    uint32_t newObjectCount = 0;
+    uint64_t bytesWritten = 0;
+};
+
+// Store an object unless one with the same content is there already
+static bool putObject(const char* dir, const ObjectKey& key, const void* data, size_t size, IngestStats& stats)
+{
+    stats.objectCount++;
+
+    std::string path = objectPath(dir, key);
+
+    FILE* existing = nullptr;
+    fopen_s(&existing, path.c_str(), "rb");
+    if (existing) {
+        long existingSize = fileSize(existing);
+        fclose(existing);
+        if (existingSize == (long)size) return true;
+    }
+
+    makeDirectory(path.substr(0, path.rfind('/')));
+
+    std::string tmpPath = tempPath(path);
+    FILE* out = nullptr;
+    fopen_s(&out, tmpPath.c_str(), "wb");
+    if (!out || !commitFile(out, tmpPath, path, fwrite(data, 1, size, out) == size)) {
+        printf("Could not write object '%s'\n", path.c_str());
+        return false;
+    }
+
+    stats.newObjectCount++;
+    stats.bytesWritten += size;
+    return true;
+}
+
+static bool readWhole(FILE* file, long offset, size_t size, std::vector<char>& buf)
+{
+    buf.resize(size);
+    if (!size) return true;
+    return fseek(file, offset, SEEK_SET) == 0 && fread(buf.data(), 1, size, file) == size;
+}
+
+static bool writeManifest(const std::string& path, const Hip& hip, const std::vector<uint64_t>& dataHashes,
+                          uint64_t archiveSize, const std::vector<Segment>& segments)
+{
+    std::string tmpPath = tempPath(path);
+    FILE* out = nullptr;
+    fopen_s(&out, tmpPath.c_str(), "wb");
+    if (!out) return false;
+
+    ManifestHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STORE_MANIFEST_MAGIC, 4);
+    header.version = STORE_MANIFEST_VERSION;
+    header.archiveSize = archiveSize;
+
+    uint32_t counts[2] = { (uint32_t)segments.size(), 0 };
+
+    // The header is written again once the size of the tables is known
+    bool written = fwrite(&header, sizeof(header), 1, out) == 1 && hip.writeTables(out, dataHashes);
+    long tablesEnd = ftell(out);
+    header.tablesSize = tablesEnd - (long)sizeof(header);
+
+    written = written && tablesEnd >= 0
+        && fwrite(counts, sizeof(counts), 1, out) == 1
+        && fwrite(segments.data(), sizeof(Segment), segments.size(), out) == segments.size()
+        && fseek(out, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, out) == 1;
+
+    return commitFile(out, tmpPath, path, written);
+}
+
+bool storeIngest(const char* dir, const char* name, const char* path)
+{
+    if (!isValidName(name)) {
+        printf("Invalid version name '%s'\n", name);
+        return false;
+    }
+
+    Hip hip;
+    if (!hip.open(path) || !hip.read()) {
+        printf("Could not read file '%s'\n", path);
+        return false;
+    }
+    hip.close();
+
+    // The bytes outside of DPAK data aren't kept by Hip, read them again
+    FILE* file = nullptr;
+    fopen_s(&file, path, "rb");
+    if (!file) {
+        printf("Could not open file '%s'\n", path);
+        return false;
+    }
+
+    long archiveSize = fileSize(file);
+    uint32_t dataStart = hip.dpak.data ? hip.dpak.dataStart : 0;
+    uint32_t dataEnd = hip.dpak.data ? hip.dpak.dataStart + hip.dpak.dataSize : 0;
+
+    std::vector<char> head;
+    std::vector<char> tail;
+    bool read = archiveSize >= (long)dataEnd
+        && readWhole(file, 0, dataStart, head)
+        && readWhole(file, dataEnd, archiveSize - dataEnd, tail);
+    fclose(file);
+    if (!read) {
+        printf("Could not read file '%s'\n", path);
+        return false;
+    }
+
+    makeDirectory(dir);
+    makeDirectory(std::string(dir) + "/objects");
+    makeDirectory(std::string(dir) + "/manifests");
+
+    IngestStats stats;
+    std::vector<Segment> segments;
+
+    Segment headSegment;
+    headSegment.key = objectKey(head.data(), head.size(), hashData(head.data(), head.size()));
+    headSegment.offset = 0;
+    headSegment.size = head.size();
+    if (!head.empty()) {
+        if (!putObject(dir, headSegment.key, head.data(), head.size(), stats)) return false;
+        segments.push_back(headSegment);
+    }
+
+    std::vector<uint64_t> dataHashes(hip.pcnt.assetCount);
+    for (uint32_t i = 0; i < hip.pcnt.assetCount; i++) {
+        dataHashes[i] = hip.ahdr[i].data ? hashData(hip.ahdr[i].data, hip.ahdr[i].size) : 0;
+    }
+
+    // Walk the assets in file order. Padding between them, and any part of an asset
+    // overlapping the previous one, goes to the fill object
+    std::vector<uint32_t> order;
+    order.reserve(hip.pcnt.assetCount);
+    for (uint32_t i = 0; i < hip.pcnt.assetCount; i++) {
+        if (hip.ahdr[i].data && hip.ahdr[i].size) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&hip](uint32_t a, uint32_t b) { return hip.ahdr[a].offset < hip.ahdr[b].offset; });
+
+    std::vector<char> fill;
+    std::vector<size_t> fillSegments; // Indices into segments, keyed once fill is complete
+
+    auto addFill = [&](const char* data, size_t size) {
+        if (!size) return;
+        Segment segment;
+        segment.offset = fill.size();
+        segment.size = size;
+        fillSegments.push_back(segments.size());
+        segments.push_back(segment);
+        fill.insert(fill.end(), data, data + size);
+    };
+
+    uint32_t pos = dataStart;
+    for (uint32_t i : order) {
+        const Hip::AHDR& ahdr = hip.ahdr[i];
+        uint32_t end = ahdr.offset + ahdr.size;
+        if (ahdr.offset < pos) {
+            if (end > pos) {
+                addFill(hip.dpak.data + (pos - dataStart), end - pos);
+                pos = end;
+            }
+            continue;
+        }
+
+        addFill(hip.dpak.data + (pos - dataStart), ahdr.offset - pos);
+
+        Segment segment;
+        segment.key = objectKey(ahdr.data, ahdr.size, dataHashes[i]);
+        segment.offset = 0;
+        segment.size = ahdr.size;
+        if (!putObject(dir, segment.key, ahdr.data, ahdr.size, stats)) return false;
+        segments.push_back(segment);
+        pos = end;
+    }
+    addFill(hip.dpak.data + (pos - dataStart), dataEnd - pos);
+    addFill(tail.data(), tail.size());
+
+    if (!fill.empty()) {
+        ObjectKey fillKey = objectKey(fill.data(), fill.size(), hashData(fill.data(), fill.size()));
+        if (!putObject(dir, fillKey, fill.data(), fill.size(), stats)) return false;
+        for (size_t i : fillSegments) segments[i].key = fillKey;
+    }
+
+    std::string manifest = manifestPath(dir, name);
+    if (!writeManifest(manifest, hip, dataHashes, archiveSize, segments)) {
+        printf("Could not write file '%s'\n", manifest.c_str());
+        return false;
+    }
+
+    printf("Stored '%s' as '%s': %u objects, %u new (%.1f MB written)\n", path, name, stats.objectCount,
+           stats.newObjectCount, stats.bytesWritten / (1024.0 * 1024.0));
+    return true;
+}
+
+// Read a manifest and check its header. Tables start at sizeof(ManifestHeader)
+static bool readManifest(const char* dir, const char* name, std::vector<char>& manifest, ManifestHeader& header)
+{
+    if (!isValidName(name)) {
+        printf("Invalid version name '%s'\n", name);
+        return false;
+    }
+
+    std::string path = manifestPath(dir, name);
+    FILE* file = nullptr;
+    fopen_s(&file, path.c_str(), "rb");
+    if (!file) {
+        printf("No version '%s' in store '%s'\n", name, dir);
+        return false;
+    }
+
+    long size = fileSize(file);
+    bool read = size >= (long)sizeof(header) && readWhole(file, 0, size, manifest);
+    fclose(file);
+
+    if (read) memcpy(&header, manifest.data(), sizeof(header));
+    if (!read || memcmp(header.magic, STORE_MANIFEST_MAGIC, 4) || header.version != STORE_MANIFEST_VERSION
+     || header.tablesSize > manifest.size() - sizeof(header)) {
+        printf("Invalid manifest '%s'\n", path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool storeLoad(const char* dir, const char* name, Hip& hip, std::vector<uint64_t>& dataHashes)
+{
+    std::vector<char> manifest;
+    ManifestHeader header;
+    if (!readManifest(dir, name, manifest, header)) return false;
+
+    if (hip.readTables(manifest.data() + sizeof(header), (size_t)header.tablesSize, dataHashes) != header.tablesSize) {
+        printf("Invalid manifest '%s'\n", manifestPath(dir, name).c_str());
+        return false;
+    }
+    return true;
+}
+
+bool storeRestore(const char* dir, const char* name, const char* path)
+{
+    std::vector<char> manifest;
+    ManifestHeader header;
+    if (!readManifest(dir, name, manifest, header)) return false;
+
+    // Segments follow the tables and the segment count
+    size_t pos = sizeof(header) + (size_t)header.tablesSize;
+    uint32_t counts[2];
+    if (manifest.size() - pos < sizeof(counts)) {
+        printf("Invalid manifest '%s'\n", manifestPath(dir, name).c_str());
+        return false;
+    }
+    memcpy(counts, manifest.data() + pos, sizeof(counts));
+    pos += sizeof(counts);
+
+    uint32_t segmentCount = counts[0];
+    if ((manifest.size() - pos) / sizeof(Segment) != segmentCount) {
+        printf("Invalid manifest '%s'\n", manifestPath(dir, name).c_str());
+        return false;
+    }
+    std::vector<Segment> segments(segmentCount);
+    if (segmentCount) memcpy(segments.data(), manifest.data() + pos, sizeof(Segment) * segmentCount);
+
+    FILE* out = nullptr;
+    fopen_s(&out, path, "wb");
+    if (!out) {
+        printf("Could not open file '%s'\n", path);
+        return false;
+    }
+
+    std::vector<char> buf(STORE_COPY_SIZE);
+    uint64_t written = 0;
+    bool ok = true;
+
+    // Fill segments alternate with assets, so keep the last two objects open: the fill
+    // object stays open while each asset object replaces the one before it
+    FILE* objects[2] = {};
+    ObjectKey objectKeys[2] = {};
+    int last = 0;
+
+    for (const Segment& segment : segments) {
+        int slot = last;
+        if (!objects[slot] || memcmp(&objectKeys[slot], &segment.key, sizeof(ObjectKey))) {
+            slot = 1 - last;
+            if (!objects[slot] || memcmp(&objectKeys[slot], &segment.key, sizeof(ObjectKey))) {
+                if (objects[slot]) fclose(objects[slot]);
+                objectKeys[slot] = segment.key;
+
+                std::string objPath = objectPath(dir, segment.key);
+                fopen_s(&objects[slot], objPath.c_str(), "rb");
+                if (!objects[slot]) {
+                    printf("Missing object '%s'\n", objPath.c_str());
+                    ok = false;
+                    break;
+                }
+            }
+        }
+        last = slot;
+        FILE* object = objects[slot];
+
+        if (fseek(object, (long)segment.offset, SEEK_SET) != 0) {
+            ok = false;
+            break;
+        }
+
+        uint64_t left = segment.size;
+        while (left && ok) {
+            size_t count = (left < buf.size()) ? (size_t)left : buf.size();
+            if (fread(buf.data(), 1, count, object) != count) {
+                printf("Object '%s' is truncated\n", objectPath(dir, segment.key).c_str());
+                ok = false;
+            } else if (fwrite(buf.data(), 1, count, out) != count) {
+                ok = false;
+            }
+            left -= count;
+            written += count;
+        }
+        if (!ok) break;
+    }
+
+    for (FILE* object : objects) {
+        if (object) fclose(object);
+    }
+    if (fclose(out) != 0) ok = false;
+
+    if (ok && written != header.archiveSize) {
+        printf("Restored %llu of %llu bytes\n", (unsigned long long)written, (unsigned long long)header.archiveSize);
+        ok = false;
+    }
+    if (!ok) printf("Could not restore '%s' to '%s'\n", name, path);
+    return ok;
+}
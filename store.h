@@ -0,0 +1,43 @@
+#pragma once
+
+#include "hip.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+// Content addressed store of archive versions. Every distinct asset payload is kept once
+// as an object named by its content, and each stored version is a manifest of its tables
+// plus the list of objects that make up the archive:
+//     <dir>/objects/<first 2 key digits>/<32 digit key>
+//     <dir>/manifests/<name>.hipm
+//
+// The bytes before DPAK data (all chunk headers) are one object per version, and the
+// padding between and after asset data is gathered into another, so an archive is restored
+// byte for byte.
+//
+// Manifest (.hipm), native endian:
+//     char     magic[4]     "HIPM"
+//     uint32_t version      1
+//     uint64_t archiveSize
+//     uint64_t tablesSize
+//     Hip tables           tablesSize bytes, see Hip::writeTables
+//     uint32_t segmentCount
+//     uint32_t reserved
+//     segmentCount times:
+//         uint64_t key[2]
+//         uint64_t offset   In the object
+//         uint64_t size
+#define STORE_MANIFEST_MAGIC "HIPM"
+#define STORE_MANIFEST_VERSION 1
+
+// Add an archive to the store as version name (letters, digits, '.', '-' and '_'),
+// replacing a version of the same name
+bool storeIngest(const char* dir, const char* name, const char* path);
+
+// Load the tables of a stored version without its asset data (AHDR data is null), with a
+// hash of each asset's data in its place. Must be done on a fresh Hip
+bool storeLoad(const char* dir, const char* name, Hip& hip, std::vector<uint64_t>& dataHashes);
+
+// Write a stored version back out as an archive, streaming its objects
+bool storeRestore(const char* dir, const char* name, const char* path);
@@ -0,0 +1,165 @@
+#include "textdiff.h"
+
+#include "hash.h"
+#include "myers.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <unordered_map>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TEXT_SCAN_SSE2 1
+#endif
+
+static inline bool isTextByte(uint8_t c)
+{
+    return (c >= 0x20 && c != 0x7F) || c == '\t' || c == '\n' || c == '\r';
+}
+
+static size_t trimPadding(const uint8_t* data, size_t size)
+{
+    while (size > 0 && data[size - 1] == '\0') size--;
+    return size;
+}
+
+bool isTextData(const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    size = trimPadding(bytes, size);
+    if (size == 0) return false;
+
+    size_t i = 0;
+
+#ifdef TEXT_SCAN_SSE2
+    // 16 bytes at a time: a byte is bad if it's a control character (0x00-0x1F, signed
+    // compare so UTF-8 bytes >= 0x80 pass) other than tab/LF/CR, or DEL
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i minusOne = _mm_set1_epi8(-1);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i del = _mm_set1_epi8(0x7F);
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(bytes + i));
+        __m128i ctrl = _mm_and_si128(_mm_cmplt_epi8(v, space), _mm_cmpgt_epi8(v, minusOne));
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(v, lf)), _mm_cmpeq_epi8(v, cr));
+        __m128i bad = _mm_or_si128(_mm_andnot_si128(ws, ctrl), _mm_cmpeq_epi8(v, del));
+        if (_mm_movemask_epi8(bad)) return false;
+    }
+#endif
+
+    for (; i < size; i++) {
+        if (!isTextByte(bytes[i])) return false;
+    }
+    return true;
+}
+
+struct TextLine
+{
+    const char* start;
+    uint32_t length;
+};
+
+static void splitLines(const void* data, size_t size, std::vector<TextLine>& lines)
+{
+    const char* text = (const char*)data;
+    size = trimPadding((const uint8_t*)data, size);
+
+    size_t start = 0;
+    while (start < size) {
+        size_t end = start;
+        while (end < size && text[end] != '\n') end++;
+
+        size_t length = end - start;
+        if (length > 0 && text[start + length - 1] == '\r') length--;
+
+        TextLine line;
+        line.start = text + start;
+        line.length = (uint32_t)length;
+        lines.push_back(line);
+
+        start = end + 1;
+    }
+}
+
+// Give every distinct line a small ID so the diff compares integers, not strings
+static void internLines(const std::vector<TextLine>& lines, std::unordered_map<uint64_t, uint32_t>& ids,
+                        std::vector<uint32_t>& out)
+{
+    out.reserve(lines.size());
+    for (const TextLine& line : lines) {
+        uint64_t hash = hashData(line.start, line.length);
+        auto it = ids.find(hash);
+        if (it == ids.end()) {
+            it = ids.insert(std::make_pair(hash, (uint32_t)ids.size())).first;
+        }
+        out.push_back(it->second);
+    }
+}
+
+static void addLine(std::vector<DecodedDiff>& diffs, Diff::Type type, const TextLine& line)
+{
+    DecodedDiff diff;
+    diff.type = type;
+    diff.depth = 1;
+
+    std::string& text = (type == Diff::Type::Deletion) ? diff.left : diff.right;
+    if (line.length > TEXT_DIFF_MAX_LINE_LENGTH) {
+        text.assign(line.start, TEXT_DIFF_MAX_LINE_LENGTH);
+        text += "...";
+    } else {
+        text.assign(line.start, line.length);
+    }
+    diffs.push_back(diff);
+}
+
+void diffTextLines(const void* odata, size_t osize, const void* mdata, size_t msize, std::vector<DecodedDiff>& diffs)
+{
+    std::vector<TextLine> olines, mlines;
+    splitLines(odata, osize, olines);
+    splitLines(mdata, msize, mlines);
+
+    std::unordered_map<uint64_t, uint32_t> ids;
+    std::vector<uint32_t> oids, mids;
+    ids.reserve(olines.size() + mlines.size());
+    internLines(olines, ids, oids);
+    internLines(mlines, ids, mids);
+
+    std::vector<std::pair<int, int>> matches;
+    myersLCS(oids.data(), (int)oids.size(), mids.data(), (int)mids.size(), matches);
+    matches.push_back(std::make_pair((int)olines.size(), (int)mlines.size()));
+
+    int lineCount = 0;
+    int o = 0, m = 0;
+    for (const std::pair<int, int>& match : matches) {
+        int ocount = match.first - o;
+        int mcount = match.second - m;
+        if (ocount > 0 || mcount > 0) {
+            if (lineCount >= TEXT_DIFF_MAX_LINES) {
+                DecodedDiff more;
+                more.type = Diff::Type::Modification;
+                more.depth = 0;
+                more.left = more.right = "(too many changed lines, stopping)";
+                diffs.push_back(more);
+                return;
+            }
+
+            char header[64];
+            snprintf(header, sizeof(header), "@@ -%d,%d +%d,%d @@", ocount ? o + 1 : o, ocount, mcount ? m + 1 : m, mcount);
+
+            DecodedDiff hunk;
+            hunk.type = Diff::Type::Modification;
+            hunk.depth = 0;
+            hunk.left = hunk.right = header;
+            diffs.push_back(hunk);
+
+            for (int i = o; i < match.first; i++) addLine(diffs, Diff::Type::Deletion, olines[i]);
+            for (int i = m; i < match.second; i++) addLine(diffs, Diff::Type::Addition, mlines[i]);
+            lineCount += ocount + mcount;
+        }
+        o = match.first + 1;
+        m = match.second + 1;
+    }
+}
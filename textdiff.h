@@ -0,0 +1,22 @@
+#pragma once
+
+#include "decoder.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+// Stop listing changed lines of one asset after this many
+#define TEXT_DIFF_MAX_LINES 1000
+
+// Longer lines are cut off
+#define TEXT_DIFF_MAX_LINE_LENGTH 200
+
+// Whether data looks like text: printable ASCII, tabs, line breaks and UTF-8 bytes only,
+// optionally followed by NUL padding
+bool isTextData(const void* data, size_t size);
+
+// Line diff of two text payloads as unified diff hunks ("@@ -1,2 +1,3 @@" headers
+// followed by the deleted and added lines), in the same form as decoder diffs
+void diffTextLines(const void* odata, size_t osize, const void* mdata, size_t msize, std::vector<DecodedDiff>& diffs);
@@ -0,0 +1,480 @@
+#include "tui.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <conio.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#endif
+
+#define ALT_SCREEN_ON  "\x1B[?1049h\x1B[?25l"
+#define ALT_SCREEN_OFF "\x1B[?25h\x1B[?1049l"
+#define HOME           "\x1B[H"
+#define CLEAR_LINE     "\x1B[K"
+#define REVERSE        "\x1B[7m"
+
+#define CTRL_C 3
+
+enum class Key
+{
+    None,
+    Up,
+    Down,
+    PageUp,
+    PageDown,
+    Home,
+    End,
+    Left,
+    Right,
+    Toggle,
+    Quit
+};
+
+struct VisibleRow
+{
+    TuiItem* item;
+    int depth;
+    int parent; // Index of the parent row, -1 for top level rows
+};
+
+TuiItem::TuiItem() : type(Diff::Type::Modification), header(false), populated(false), expanded(false)
+{
+}
+
+TuiItem tuiHeader(const char* title, int count)
+{
+    char buf[64];
+    if (count == -1) snprintf(buf, sizeof(buf), "%s", title);
+    else snprintf(buf, sizeof(buf), "%s (%d)", title, count);
+
+    TuiItem item;
+    item.left = buf;
+    item.right = buf;
+    item.header = true;
+    return item;
+}
+
+TuiItem tuiItem(const Diff& diff)
+{
+    char buf[256];
+
+    // Indentation comes from the tree, not the format
+    TuiItem item;
+    item.type = diff.type;
+    if (diff.type != Diff::Type::Addition) {
+        formatDiffSide(diff, true, buf, sizeof(buf));
+        item.left = buf + strspn(buf, " ");
+    }
+    if (diff.type != Diff::Type::Deletion) {
+        formatDiffSide(diff, false, buf, sizeof(buf));
+        item.right = buf + strspn(buf, " ");
+    }
+    return item;
+}
+
+TuiItem tuiItem(Diff::Type type, const char* left, const char* right)
+{
+    TuiItem item;
+    item.type = type;
+    if (left) item.left = left;
+    if (right) item.right = right;
+    return item;
+}
+
+class Terminal
+{
+public:
+    Terminal();
+    ~Terminal();
+
+    bool open();
+    void getSize(int* rows, int* cols);
+    Key readKey();
+
+private:
+    bool opened;
+#ifndef _WIN32
+    struct sigaction oldTermAction;
+    struct sigaction oldHupAction;
+
+    bool readByte(char* c, int timeoutMs);
+#endif
+};
+
+// The terminal state to restore, global so a signal (or console control) handler can put
+// it back before the process dies. Ctrl+C is read as a key, this covers being killed
+#ifdef _WIN32
+
+static HANDLE consoleOutput;
+static DWORD savedOutputMode;
+
+static BOOL WINAPI onConsoleControl(DWORD event)
+{
+    (void)event;
+    DWORD written;
+    WriteConsoleA(consoleOutput, ALT_SCREEN_OFF, sizeof(ALT_SCREEN_OFF) - 1, &written, NULL);
+    SetConsoleMode(consoleOutput, savedOutputMode);
+    return FALSE; // Let the default handler end the process
+}
+
+#else
+
+static struct termios savedAttrs;
+
+static void onTerminateSignal(int sig)
+{
+    // Only async-signal-safe calls in here
+    ssize_t written = write(STDOUT_FILENO, ALT_SCREEN_OFF, sizeof(ALT_SCREEN_OFF) - 1);
+    (void)written;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &savedAttrs);
+
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+#endif
+
+Terminal::Terminal() : opened(false)
+{
+}
+
+Terminal::~Terminal()
+{
+    if (!opened) return;
+
+    fputs(ALT_SCREEN_OFF, stdout);
+    fflush(stdout);
+#ifdef _WIN32
+    SetConsoleCtrlHandler(onConsoleControl, FALSE);
+    SetConsoleMode(consoleOutput, savedOutputMode);
+#else
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &savedAttrs);
+    sigaction(SIGTERM, &oldTermAction, nullptr);
+    sigaction(SIGHUP, &oldHupAction, nullptr);
+#endif
+}
+
+bool Terminal::open()
+{
+#ifdef _WIN32
+    if (!_isatty(_fileno(stdin)) || !_isatty(_fileno(stdout))) return false;
+
+    consoleOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (!GetConsoleMode(consoleOutput, &savedOutputMode)) return false;
+    if (!SetConsoleMode(consoleOutput, savedOutputMode | ENABLE_VIRTUAL_TERMINAL_PROCESSING)) return false;
+
+    SetConsoleCtrlHandler(onConsoleControl, TRUE);
+#else
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) return false;
+    if (tcgetattr(STDIN_FILENO, &savedAttrs) != 0) return false;
+
+    // Without ISIG, Ctrl+C arrives as a key and quits through the normal restore path
+    struct termios attrs = savedAttrs;
+    attrs.c_lflag &= ~(ICANON | ECHO | ISIG);
+    attrs.c_cc[VMIN] = 1;
+    attrs.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &attrs) != 0) return false;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onTerminateSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, &oldTermAction);
+    sigaction(SIGHUP, &action, &oldHupAction);
+#endif
+
+    opened = true;
+    fputs(ALT_SCREEN_ON, stdout);
+    fflush(stdout);
+    return true;
+}
+
+void Terminal::getSize(int* rows, int* cols)
+{
+    *rows = 24;
+    *cols = 80;
+#ifdef _WIN32
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    if (GetConsoleScreenBufferInfo(consoleOutput, &info)) {
+        *rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+        *cols = info.srWindow.Right - info.srWindow.Left + 1;
+    }
+#else
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0) {
+        *rows = size.ws_row;
+        *cols = size.ws_col;
+    }
+#endif
+}
+
+#ifdef _WIN32
+
+Key Terminal::readKey()
+{
+    int c = _getch();
+    if (c == 0 || c == 0xE0) {
+        switch (_getch()) {
+        case 72: return Key::Up;
+        case 80: return Key::Down;
+        case 73: return Key::PageUp;
+        case 81: return Key::PageDown;
+        case 71: return Key::Home;
+        case 79: return Key::End;
+        case 75: return Key::Left;
+        case 77: return Key::Right;
+        }
+        return Key::None;
+    }
+
+    switch (c) {
+    case 'k': return Key::Up;
+    case 'j': return Key::Down;
+    case 'g': return Key::Home;
+    case 'G': return Key::End;
+    case 'h': return Key::Left;
+    case 'l': return Key::Right;
+    case '\r':
+    case ' ': return Key::Toggle;
+    case 'q':
+    case CTRL_C:
+    case 27: return Key::Quit;
+    }
+    return Key::None;
+}
+
+#else
+
+bool Terminal::readByte(char* c, int timeoutMs)
+{
+    if (timeoutMs >= 0) {
+        struct pollfd pfd;
+        pfd.fd = STDIN_FILENO;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, timeoutMs) <= 0) return false;
+    }
+    return read(STDIN_FILENO, c, 1) == 1;
+}
+
+Key Terminal::readKey()
+{
+    char c;
+    if (!readByte(&c, -1)) return Key::Quit;
+
+    if (c == 27) {
+        // A lone escape is the escape key, otherwise an escape sequence follows right away
+        char seq[3];
+        if (!readByte(&seq[0], 50)) return Key::Quit;
+        if (seq[0] != '[' && seq[0] != 'O') return Key::None;
+        if (!readByte(&seq[1], 50)) return Key::None;
+
+        switch (seq[1]) {
+        case 'A': return Key::Up;
+        case 'B': return Key::Down;
+        case 'C': return Key::Right;
+        case 'D': return Key::Left;
+        case 'H': return Key::Home;
+        case 'F': return Key::End;
+        }
+
+        if (seq[1] >= '0' && seq[1] <= '9') {
+            if (!readByte(&seq[2], 50) || seq[2] != '~') return Key::None;
+            switch (seq[1]) {
+            case '1':
+            case '7': return Key::Home;
+            case '4':
+            case '8': return Key::End;
+            case '5': return Key::PageUp;
+            case '6': return Key::PageDown;
+            }
+        }
+        return Key::None;
+    }
+
+    switch (c) {
+    case 'k': return Key::Up;
+    case 'j': return Key::Down;
+    case 'g': return Key::Home;
+    case 'G': return Key::End;
+    case 'h': return Key::Left;
+    case 'l': return Key::Right;
+    case '\n':
+    case '\r':
+    case ' ': return Key::Toggle;
+    case 'q':
+    case CTRL_C: return Key::Quit;
+    }
+    return Key::None;
+}
+
+#endif
+
+static void flatten(std::vector<TuiItem>& items, int depth, int parent, std::vector<VisibleRow>& rows)
+{
+    for (TuiItem& item : items) {
+        VisibleRow row;
+        row.item = &item;
+        row.depth = depth;
+        row.parent = parent;
+        rows.push_back(row);
+
+        if (item.expanded) {
+            flatten(item.children, depth + 1, (int)rows.size() - 1, rows);
+        }
+    }
+}
+
+static void setExpanded(TuiItem& item, bool expanded)
+{
+    if (!item.expand) return;
+
+    if (expanded && !item.populated) {
+        item.expand(item.children);
+        item.populated = true;
+    }
+    item.expanded = expanded;
+}
+
+// Write text into a cell of exactly width characters
+static void writeCell(OutputBuffer& out, int indent, const char* marker, const std::string& text, int width)
+{
+    int n = 0;
+    for (int i = 0; i < indent && n < width; i++, n++) out.writeChar(' ');
+    for (const char* c = marker; *c && n < width; c++, n++) out.writeChar(*c);
+
+    int len = (int)text.size();
+    if (len > width - n) len = width - n;
+    if (len > 0) {
+        out.write(text.data(), len);
+        n += len;
+    }
+
+    for (; n < width; n++) out.writeChar(' ');
+}
+
+static void draw(OutputBuffer& out, const char* oname, const char* mname, const std::vector<VisibleRow>& rows,
+                 int top, int selected, int screenRows, int screenCols)
+{
+    int columnWidth = screenCols / 2;
+    int bodyRows = screenRows - 3;
+
+    out.writeString(HOME);
+    writeCell(out, 0, "", oname, columnWidth);
+    writeCell(out, 0, "", mname, screenCols - columnWidth);
+    out.writeString("\r\n");
+    for (int i = 0; i < screenCols; i++) out.writeChar('=');
+    out.writeString("\r\n");
+
+    // Only the rows on screen are drawn, whatever the total number of rows
+    for (int r = 0; r < bodyRows; r++) {
+        int idx = top + r;
+        if (idx < (int)rows.size()) {
+            const VisibleRow& row = rows[idx];
+            const TuiItem& item = *row.item;
+
+            if (!item.header) {
+                switch (item.type) {
+                case Diff::Type::Addition: out.writeString(GRN); break;
+                case Diff::Type::Deletion: out.writeString(RED); break;
+                case Diff::Type::Modification: out.writeString(YEL); break;
+                }
+            }
+            if (idx == selected) out.writeString(REVERSE);
+
+            const char* marker = !item.expand ? "  " : (item.expanded ? "- " : "+ ");
+            writeCell(out, row.depth * 2, marker, item.left, columnWidth);
+            writeCell(out, row.depth * 2, marker, item.right, screenCols - columnWidth);
+            out.writeString(RESET);
+        } else {
+            out.writeString(CLEAR_LINE);
+        }
+        out.writeString("\r\n");
+    }
+
+    char status[128];
+    snprintf(status, sizeof(status), "%d/%d  up/down: move  enter/space: expand  left: collapse  q: quit",
+             rows.empty() ? 0 : selected + 1, (int)rows.size());
+    out.writeString(REVERSE);
+    writeCell(out, 0, "", status, screenCols);
+    out.writeString(RESET);
+    out.flush();
+}
+
+bool runTui(const char* oname, const char* mname, std::vector<TuiItem>& items)
+{
+    Terminal term;
+    if (!term.open()) return false;
+
+    OutputBuffer out(stdout);
+    std::vector<VisibleRow> rows;
+    flatten(items, 0, -1, rows);
+
+    int selected = 0;
+    int top = 0;
+
+    while (true) {
+        int screenRows, screenCols;
+        term.getSize(&screenRows, &screenCols);
+        int bodyRows = screenRows - 3;
+        if (bodyRows < 1) bodyRows = 1;
+
+        if (selected >= (int)rows.size()) selected = (int)rows.size() - 1;
+        if (selected < 0) selected = 0;
+        if (selected < top) top = selected;
+        if (selected >= top + bodyRows) top = selected - bodyRows + 1;
+
+        draw(out, oname, mname, rows, top, selected, screenRows, screenCols);
+
+        Key key = term.readKey();
+        if (key == Key::Quit) break;
+        if (rows.empty()) continue;
+
+        TuiItem* item = rows[selected].item;
+        bool changed = false;
+
+        switch (key) {
+        case Key::Up: selected--; break;
+        case Key::Down: selected++; break;
+        case Key::PageUp: selected -= bodyRows; break;
+        case Key::PageDown: selected += bodyRows; break;
+        case Key::Home: selected = 0; break;
+        case Key::End: selected = (int)rows.size() - 1; break;
+        case Key::Toggle:
+            setExpanded(*item, !item->expanded);
+            changed = true;
+            break;
+        case Key::Right:
+            if (item->expand && !item->expanded) {
+                setExpanded(*item, true);
+                changed = true;
+            }
+            break;
+        case Key::Left:
+            if (item->expanded) {
+                setExpanded(*item, false);
+                changed = true;
+            } else if (rows[selected].parent != -1) {
+                selected = rows[selected].parent;
+            }
+            break;
+        default:
+            break;
+        }
+
+        // Rows only need to be rebuilt when the tree changed, the selected row stays put
+        if (changed) {
+            rows.clear();
+            flatten(items, 0, -1, rows);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "output.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// A row in the interactive browser. Children are only created when the row is first
+// expanded, so details of large diffs are computed on demand
+struct TuiItem
+{
+    Diff::Type type;
+    std::string left;  // Unused for additions
+    std::string right; // Unused for deletions
+    bool header;       // Section header, drawn without diff colors
+
+    std::function<void(std::vector<TuiItem>& children)> expand; // Empty for leaf rows
+
+    std::vector<TuiItem> children;
+    bool populated;
+    bool expanded;
+
+    TuiItem();
+};
+
+TuiItem tuiHeader(const char* title, int count);
+TuiItem tuiItem(const Diff& diff);
+TuiItem tuiItem(Diff::Type type, const char* left, const char* right);
+
+// Browse the items until the user quits. Returns false if stdin/stdout is not a terminal
+bool runTui(const char* oname, const char* mname, std::vector<TuiItem>& items);
@@ -0,0 +1,138 @@
+#include "validate.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include <algorithm>
+
+// Stop listing problems after this many, a badly broken file would otherwise list one per asset
+#define VALIDATE_MAX_PROBLEMS 100
+
+static void addProblem(std::vector<std::string>& problems, const char* fmt, ...)
+{
+    if (problems.size() >= VALIDATE_MAX_PROBLEMS) return;
+
+    char buf[256];
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    problems.push_back(buf);
+    if (problems.size() == VALIDATE_MAX_PROBLEMS) {
+        problems.push_back("(too many problems, stopping)");
+    }
+}
+
+struct AssetRange
+{
+    uint32_t offset;
+    uint32_t size;
+    uint32_t id;
+
+    bool operator<(const AssetRange& other) const
+    {
+        if (offset != other.offset) return offset < other.offset;
+        return size < other.size;
+    }
+};
+
+bool validateHip(const Hip& hip, std::vector<std::string>& problems)
+{
+    size_t problemCount = problems.size();
+
+    // Counts
+    if (hip.atoc.ahdrCount != hip.pcnt.assetCount)
+        addProblem(problems, "PCNT assetCount is %u but ATOC has %u AHDR chunks", hip.pcnt.assetCount, hip.atoc.ahdrCount);
+    if (hip.ltoc.lhdrCount != hip.pcnt.layerCount)
+        addProblem(problems, "PCNT layerCount is %u but LTOC has %u LHDR chunks", hip.pcnt.layerCount, hip.ltoc.lhdrCount);
+    if (hip.ltoc.assetIDCount != hip.pcnt.assetCount)
+        addProblem(problems, "PCNT assetCount is %u but layers reference %u assets", hip.pcnt.assetCount, hip.ltoc.assetIDCount);
+
+    uint32_t assetCount = hip.atoc.ahdrCount;
+    uint32_t layerCount = hip.ltoc.lhdrCount;
+
+    if (assetCount > 0 && !hip.dpak.data) {
+        addProblem(problems, "File has %u assets but no DPAK data", assetCount);
+    }
+
+    // Sizes
+    uint32_t maxAssetSize = 0;
+    for (uint32_t i = 0; i < assetCount; i++) {
+        if (hip.ahdr[i].size > maxAssetSize) maxAssetSize = hip.ahdr[i].size;
+    }
+    if (hip.pcnt.maxAssetSize != maxAssetSize)
+        addProblem(problems, "PCNT maxAssetSize is %u but the largest asset is %u bytes", hip.pcnt.maxAssetSize, maxAssetSize);
+
+    // Asset IDs sorted with their index, to find duplicates and look up layer asset IDs
+    std::vector<std::pair<uint32_t, uint32_t>> ids(assetCount);
+    for (uint32_t i = 0; i < assetCount; i++) {
+        ids[i] = std::make_pair(hip.ahdr[i].id, i);
+    }
+    std::sort(ids.begin(), ids.end());
+    for (uint32_t i = 1; i < assetCount; i++) {
+        if (ids[i].first == ids[i-1].first)
+            addProblem(problems, "Asset ID 0x%08X appears more than once in ATOC", ids[i].first);
+    }
+
+    // Layers may pad asset data for alignment, so the declared max layer size can be
+    // larger than the sum of its asset sizes, but never smaller
+    uint64_t maxLayerSize = 0;
+    uint32_t maxLayer = 0;
+    for (uint32_t i = 0; i < layerCount; i++) {
+        const Hip::LHDR& lhdr = hip.lhdr[i];
+        uint64_t layerSize = 0;
+        for (uint32_t j = 0; j < lhdr.assetCount; j++) {
+            uint32_t id = lhdr.assetIDs[j];
+            auto it = std::lower_bound(ids.begin(), ids.end(), std::make_pair(id, (uint32_t)0));
+            if (it == ids.end() || it->first != id) {
+                addProblem(problems, "Layer %u references asset 0x%08X which is not in ATOC", i, id);
+                continue;
+            }
+            layerSize += hip.ahdr[it->second].size;
+        }
+        if (layerSize > maxLayerSize) {
+            maxLayerSize = layerSize;
+            maxLayer = i;
+        }
+    }
+    if (hip.pcnt.maxLayerSize < maxLayerSize)
+        addProblem(problems, "PCNT maxLayerSize is %u but layer %u has %llu bytes of assets",
+                   hip.pcnt.maxLayerSize, maxLayer, (unsigned long long)maxLayerSize);
+
+    // Asset data ranges, in one pass over the assets sorted by offset
+    if (hip.dpak.data) {
+        std::vector<AssetRange> ranges(assetCount);
+        for (uint32_t i = 0; i < assetCount; i++) {
+            ranges[i].offset = hip.ahdr[i].offset;
+            ranges[i].size = hip.ahdr[i].size;
+            ranges[i].id = hip.ahdr[i].id;
+        }
+        std::sort(ranges.begin(), ranges.end());
+
+        uint64_t dataStart = hip.dpak.dataStart;
+        uint64_t dataEnd = dataStart + hip.dpak.dataSize;
+        uint64_t prevEnd = dataStart;
+        uint32_t prevID = 0;
+        bool hasPrev = false;
+        for (const AssetRange& r : ranges) {
+            uint64_t start = r.offset;
+            uint64_t end = start + r.size;
+            if (start < dataStart || end > dataEnd) {
+                addProblem(problems, "Asset 0x%08X data (offset %u, size %u) is outside of DPAK", r.id, r.offset, r.size);
+                continue;
+            }
+            if (hasPrev && start < prevEnd && r.size > 0) {
+                addProblem(problems, "Asset 0x%08X data overlaps asset 0x%08X", r.id, prevID);
+            }
+            if (end > prevEnd || !hasPrev) {
+                prevEnd = end;
+                prevID = r.id;
+            }
+            hasPrev = true;
+        }
+    }
+
+    return problems.size() == problemCount;
+}
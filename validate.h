@@ -0,0 +1,11 @@
+#pragma once
+
+#include "hip.h"
+
+#include <string>
+#include <vector>
+
+// Check a parsed HIP file for integrity problems the parser itself tolerates:
+// overlapping asset data, PCNT counts and sizes not matching the actual tables,
+// and layers referencing assets missing from ATOC. Returns true if no problems were found
+bool validateHip(const Hip& hip, std::vector<std::string>& problems);
@@ -0,0 +1,169 @@
+#include "watch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+// Exporters usually write a file in several steps, so wait this long after the
+// last change event before reporting the file as rewritten
+#define WATCH_SETTLE_MS 100
+
+static void splitPath(const char* path, char* dir, char* name)
+{
+    const char* sep = nullptr;
+    for (const char* c = path; *c; c++) {
+        if (*c == '/' || *c == '\\') sep = c;
+    }
+
+    if (sep) {
+        size_t len = sep - path;
+        if (len == 0) len = 1;
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+        strcpy(name, sep + 1);
+    } else {
+        strcpy(dir, ".");
+        strcpy(name, path);
+    }
+}
+
+FileWatcher::FileWatcher()
+{
+    memset(this, 0, sizeof(*this));
+
+#ifdef _WIN32
+    handle = INVALID_HANDLE_VALUE;
+#else
+    fd = -1;
+    wd = -1;
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+static unsigned long long getLastWriteTime(const char* path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) return 0;
+    return ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+}
+
+bool FileWatcher::open(const char* path)
+{
+    if (strlen(path) >= WATCH_MAX_PATH) return false;
+
+    strcpy(this->path, path);
+    splitPath(path, dir, name);
+
+    handle = FindFirstChangeNotificationA(dir, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    lastWriteTime = getLastWriteTime(path);
+    return true;
+}
+
+void FileWatcher::close()
+{
+    if (handle != INVALID_HANDLE_VALUE) {
+        FindCloseChangeNotification(handle);
+        handle = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool FileWatcher::wait()
+{
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    // Directory notifications don't say which file changed, so compare write times
+    while (true) {
+        if (WaitForSingleObject(handle, INFINITE) != WAIT_OBJECT_0) return false;
+        if (!FindNextChangeNotification(handle)) return false;
+
+        // Wait for the writer to settle
+        while (WaitForSingleObject(handle, WATCH_SETTLE_MS) == WAIT_OBJECT_0) {
+            if (!FindNextChangeNotification(handle)) return false;
+        }
+
+        unsigned long long time = getLastWriteTime(path);
+        if (time != 0 && time != lastWriteTime) {
+            lastWriteTime = time;
+            return true;
+        }
+    }
+}
+
+#else
+
+bool FileWatcher::open(const char* path)
+{
+    if (strlen(path) >= WATCH_MAX_PATH) return false;
+
+    splitPath(path, dir, name);
+
+    fd = inotify_init1(IN_CLOEXEC);
+    if (fd == -1) return false;
+
+    // Watch the directory rather than the file itself so we also catch the file
+    // being replaced by a rename (which would orphan a watch on the old inode)
+    wd = inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd == -1) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void FileWatcher::close()
+{
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+        wd = -1;
+    }
+}
+
+bool FileWatcher::wait()
+{
+    if (fd == -1) return false;
+
+    alignas(struct inotify_event) char buf[4096];
+    bool changed = false;
+
+    while (true) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        // Block until the first matching event, then keep draining until the writer settles
+        int ret = poll(&pfd, 1, changed ? WATCH_SETTLE_MS : -1);
+        if (ret < 0) return false;
+        if (ret == 0) return true;
+
+        ssize_t len = read(fd, buf, sizeof(buf));
+        if (len <= 0) return false;
+
+        for (char* p = buf; p < buf + len; ) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            if (ev->len > 0 && !strcmp(ev->name, name)) {
+                changed = true;
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+#endif
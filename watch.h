@@ -0,0 +1,29 @@
+#pragma once
+
+#define WATCH_MAX_PATH 1024
+
+// Waits for a file to be rewritten (written and closed, or replaced by a rename)
+class FileWatcher
+{
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    bool open(const char* path);
+    void close();
+
+    bool wait();
+
+private:
+    char dir[WATCH_MAX_PATH];
+    char name[WATCH_MAX_PATH];
+
+#ifdef _WIN32
+    void* handle;
+    char path[WATCH_MAX_PATH];
+    unsigned long long lastWriteTime;
+#else
+    int fd;
+    int wd;
+#endif
+};